@@ -5,9 +5,67 @@
 
 #include"DendroParticle.h"
 #include"DendroMesh.h"
+#include"DendroMemory.h"
+#include"DendroCache.h"
+#include"DendroTrace.h"
+#include"DendroFilter.h"
 #include <openvdb/util/Util.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <algorithm>
 #include <vector>
 
+namespace {
+
+	// run op on every valid grid of a batch concurrently. the largest grids are started first so a big
+	// item picked up late cannot stall the batch, tbb work stealing spreads the rest across cores
+	template<typename OpT>
+	void RunBatch(DendroGrid ** grids, int gCount, const OpT& op)
+	{
+		std::vector<int> order;
+		std::vector<openvdb::Index64> sizes(gCount > 0 ? gCount : 0, 0);
+
+		for (int i = 0; i < gCount; i++) {
+			auto grid = (grids[i] != NULL) ? grids[i]->Grid() : nullptr;
+			if (grid) {
+				sizes[i] = grid->activeVoxelCount();
+				order.push_back(i);
+			}
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return sizes[a] > sizes[b]; });
+
+		DendroTrace::Span span("batch");
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, order.size(), 1), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				op(order[n]);
+			}
+		}, tbb::simple_partitioner());
+	}
+
+	// flat 16 value matrix as passed in from c#
+	inline openvdb::math::Mat4d MatrixFromArray(const double * matrix)
+	{
+		return openvdb::math::Mat4d(matrix[0], matrix[1], matrix[2], matrix[3],
+			matrix[4], matrix[5], matrix[6], matrix[7],
+			matrix[8], matrix[9], matrix[10], matrix[11],
+			matrix[12], matrix[13], matrix[14], matrix[15]);
+	}
+
+	// a parameter array either has one value per grid or a single value shared by all of them
+	inline bool BatchCount(int vCount, int gCount)
+	{
+		return vCount == 1 || vCount == gCount;
+	}
+
+	template<typename T>
+	inline T BatchParam(const T * values, int vCount, int i)
+	{
+		return values[(vCount == 1) ? 0 : i];
+	}
+}
+
 // grid class constructors
 DENDRO_API DendroGrid* DendroCreate()
 {
@@ -43,54 +101,26 @@ DENDRO_API bool DendroWrite(DendroGrid * grid, const char * filename)
 // grid conversion methods
 DENDRO_API bool DendroFromPoints(DendroGrid * grid, double *vPoints, int pCount, double *vRadius, int rCount, double voxelSize, double bandwidth)
 {
-	double inverseVoxelSize = 1.0 / voxelSize;
+	const int count = pCount / 3;
 
-	std::vector<openvdb::Vec3R> particleList;
-
-	int i = 0;
-	while (i < pCount)
-	{
-		double x = vPoints[i]; // *inverseVoxelSize;
-		double y = vPoints[i + 1]; // * inverseVoxelSize;
-		double z = vPoints[i + 2]; // * inverseVoxelSize;
-
-		particleList.push_back(openvdb::Vec3R(x, y, z));
-
-		i += 3;
-	}
-
-	DendroParticle ps;
-	ps.clear();
-
-	if (particleList.size() == rCount)
-	{
-
-		int i = 0;
-		for (auto it = particleList.begin(); it != particleList.end(); ++it)
-		{
-			ps.add((*it), openvdb::Real(vRadius[i]));
-			i++;
-		}
-	}
-	else
-	{
-
-		double average = 0.0;
-		for (int i = 0; i < rCount; i++)
-		{
+	// a radius per point, otherwise every point takes the average
+	openvdb::Real average = 0.0;
+	if (count != rCount && rCount > 0) {
+		for (int i = 0; i < rCount; i++) {
 			average += vRadius[i];
 		}
 		average /= rCount;
-		openvdb::Real radius = openvdb::Real(average);
+	}
 
-		for (auto it = particleList.begin(); it != particleList.end(); ++it)
-		{
-			ps.add((*it), radius);
-		}
+	DendroParticle ps;
+	ps.reserve(count);
+
+	for (int i = 0; i < count; i++) {
+		const openvdb::Vec3R p(vPoints[i * 3], vPoints[i * 3 + 1], vPoints[i * 3 + 2]);
+		ps.add(p, (count == rCount) ? openvdb::Real(vRadius[i]) : average);
 	}
 
 	return grid->CreateFromPoints(ps, voxelSize, bandwidth);
-
 }
 
 DENDRO_API bool DendroFromMesh(DendroGrid * grid, float* vPoints, int vCount, int * vFaces, int fCount, double voxelSize, double bandwidth)
@@ -125,6 +155,53 @@ DENDRO_API bool DendroFromMesh(DendroGrid * grid, float* vPoints, int vCount, in
 }
 
 
+// grid primitive constructors
+DENDRO_API bool DendroFromSphere(DendroGrid * grid, double * matrix, int mCount, double radius, double voxelSize, double bandwidth)
+{
+	if (mCount != 16) {
+		return false;
+	}
+
+	return grid->CreateSphere(MatrixFromArray(matrix), radius, voxelSize, bandwidth);
+}
+
+DENDRO_API bool DendroFromBox(DendroGrid * grid, double * matrix, int mCount, double x, double y, double z, double voxelSize, double bandwidth)
+{
+	if (mCount != 16) {
+		return false;
+	}
+
+	return grid->CreateBox(MatrixFromArray(matrix), x, y, z, voxelSize, bandwidth);
+}
+
+DENDRO_API bool DendroFromCylinder(DendroGrid * grid, double * matrix, int mCount, double radius, double height, double voxelSize, double bandwidth)
+{
+	if (mCount != 16) {
+		return false;
+	}
+
+	return grid->CreateCylinder(MatrixFromArray(matrix), radius, height, voxelSize, bandwidth);
+}
+
+DENDRO_API bool DendroFromTorus(DendroGrid * grid, double * matrix, int mCount, double majorRadius, double minorRadius, double voxelSize, double bandwidth)
+{
+	if (mCount != 16) {
+		return false;
+	}
+
+	return grid->CreateTorus(MatrixFromArray(matrix), majorRadius, minorRadius, voxelSize, bandwidth);
+}
+
+DENDRO_API bool DendroFromCapsule(DendroGrid * grid, double * matrix, int mCount, double radius, double height, double voxelSize, double bandwidth)
+{
+	if (mCount != 16) {
+		return false;
+	}
+
+	return grid->CreateCapsule(MatrixFromArray(matrix), radius, height, voxelSize, bandwidth);
+}
+
+
 // grid render methods
 DENDRO_API void DendroToMesh(DendroGrid * grid)
 {
@@ -136,22 +213,74 @@ DENDRO_API void DendroToMeshSettings(DendroGrid * grid, double isovalue, double
 	grid->UpdateDisplay(isovalue, adaptivity);
 }
 
+DENDRO_API void DendroToMeshDecimate(DendroGrid * grid, double isovalue, double adaptivity, int targetFaces, double maxError)
+{
+	grid->UpdateDisplay(isovalue, adaptivity, targetFaces, maxError);
+}
+
 DENDRO_API float* DendroVertexBuffer(DendroGrid * grid, int * size)
 {
-	float *verticeArray = grid->GetMeshVertices();
+	return grid->GetMeshVertices(*size);
+}
 
-	*size = grid->GetVertexCount();
+DENDRO_API int * DendroFaceBuffer(DendroGrid * grid, int * size)
+{
+	return grid->GetMeshFaces(*size);
+}
 
-	return verticeArray;
+DENDRO_API float * DendroNormalBuffer(DendroGrid * grid, int * size)
+{
+	return grid->GetMeshNormals(*size);
 }
 
-DENDRO_API int * DendroFaceBuffer(DendroGrid * grid, int * size)
+DENDRO_API void DendroToMeshBuffers(DendroGrid * grid, double isovalue, double adaptivity, int targetFaces, double maxError, float ** vertices, int * vSize, int ** faces, int * fSize, float ** normals, int * nSize)
 {
-	int *faceArray = grid->GetMeshFaces();
+	DendroMesh mesh = grid->Mesh(isovalue, adaptivity, targetFaces, maxError);
 
-	*size = grid->GetFaceCount();
+	*vertices = mesh.VertexBuffer(*vSize);
+	*faces = mesh.FaceBuffer(*fSize);
+	*normals = mesh.NormalBuffer(*nSize);
+}
 
-	return faceArray;
+DENDRO_API bool DendroExportMesh(DendroGrid * grid, const char * path, int format, double isovalue, double adaptivity)
+{
+	return grid->Export(path, format, isovalue, adaptivity);
+}
+
+DENDRO_API bool DendroToDense(DendroGrid * grid, double * bbox, int bCount, bool world, int step, float * buffer, long long * strides, int * dims)
+{
+	if (bCount != 6) {
+		return false;
+	}
+
+	openvdb::Vec3d bMin(bbox[0], bbox[1], bbox[2]);
+	openvdb::Vec3d bMax(bbox[3], bbox[4], bbox[5]);
+
+	return grid->ToDense(bMin, bMax, world, step, buffer, reinterpret_cast<const int64_t*>(strides), dims);
+}
+
+DENDRO_API bool DendroFromDense(DendroGrid * grid, double * bbox, int bCount, bool world, int step, float * buffer, long long * strides, double threshold)
+{
+	if (bCount != 6) {
+		return false;
+	}
+
+	openvdb::Vec3d bMin(bbox[0], bbox[1], bbox[2]);
+	openvdb::Vec3d bMax(bbox[3], bbox[4], bbox[5]);
+
+	return grid->FromDense(bMin, bMax, world, step, buffer, reinterpret_cast<const int64_t*>(strides), threshold);
+}
+
+DENDRO_API bool DendroFromDenseCreate(DendroGrid * grid, double * bbox, int bCount, bool world, int step, float * buffer, long long size, long long * strides, double threshold, double voxelSize, double bandwidth, bool levelSet)
+{
+	if (bCount != 6) {
+		return false;
+	}
+
+	openvdb::Vec3d bMin(bbox[0], bbox[1], bbox[2]);
+	openvdb::Vec3d bMax(bbox[3], bbox[4], bbox[5]);
+
+	return grid->FromDense(bMin, bMax, world, step, buffer, static_cast<int64_t>(size), reinterpret_cast<const int64_t*>(strides), threshold, voxelSize, bandwidth, levelSet);
 }
 
 
@@ -162,10 +291,7 @@ DENDRO_API bool DendroTransform(DendroGrid *grid, double *matrix, int mCount)
 		return false;
 	}
 
-	openvdb::math::Mat4d xform = openvdb::math::Mat4d(matrix[0], matrix[1], matrix[2], matrix[3],
-		matrix[4], matrix[5], matrix[6], matrix[7],
-		matrix[8], matrix[9], matrix[10], matrix[11],
-		matrix[12], matrix[13], matrix[14], matrix[15]);
+	openvdb::math::Mat4d xform = MatrixFromArray(matrix);
 
 	grid->Transform(xform);
 
@@ -189,6 +315,21 @@ DENDRO_API void DendroIntersection(DendroGrid * grid, DendroGrid * csgGrid)
 	grid->BooleanIntersection(*csgGrid);
 }
 
+DENDRO_API void DendroSmoothUnion(DendroGrid * grid, DendroGrid * csgGrid, double radius, int kernel)
+{
+	grid->BooleanUnion(*csgGrid, radius, kernel);
+}
+
+DENDRO_API void DendroSmoothDifference(DendroGrid * grid, DendroGrid * csgGrid, double radius, int kernel)
+{
+	grid->BooleanDifference(*csgGrid, radius, kernel);
+}
+
+DENDRO_API void DendroSmoothIntersection(DendroGrid * grid, DendroGrid * csgGrid, double radius, int kernel)
+{
+	grid->BooleanIntersection(*csgGrid, radius, kernel);
+}
+
 
 // grid filter methods
 DENDRO_API void DendroOffset(DendroGrid * grid, double amount)
@@ -221,6 +362,110 @@ DENDRO_API void DendroBlendMask(DendroGrid * bGrid, DendroGrid * eGrid, double b
 	bGrid->Blend(*eGrid, bPosition, bEnd, *mask, min, max, invert);
 }
 
+// grid batch methods
+DENDRO_API bool DendroOffsetBatch(DendroGrid ** grids, int gCount, double * amounts, int aCount)
+{
+	if (!BatchCount(aCount, gCount)) {
+		return false;
+	}
+
+	RunBatch(grids, gCount, [&](int i) {
+		grids[i]->Offset(BatchParam(amounts, aCount, i));
+	});
+
+	return true;
+}
+
+DENDRO_API bool DendroSmoothBatch(DendroGrid ** grids, int gCount, int * types, int * iterations, int * widths, int pCount)
+{
+	if (!BatchCount(pCount, gCount)) {
+		return false;
+	}
+
+	RunBatch(grids, gCount, [&](int i) {
+		grids[i]->Smooth(BatchParam(types, pCount, i), BatchParam(iterations, pCount, i), BatchParam(widths, pCount, i));
+	});
+
+	return true;
+}
+
+DENDRO_API void DendroToMeshBatch(DendroGrid ** grids, int gCount, double isovalue, double adaptivity, int targetFaces, double maxError)
+{
+	RunBatch(grids, gCount, [&](int i) {
+		grids[i]->UpdateDisplay(isovalue, adaptivity, targetFaces, maxError);
+	});
+}
+
+DENDRO_API void DendroToMeshDefaultBatch(DendroGrid ** grids, int gCount)
+{
+	RunBatch(grids, gCount, [&](int i) {
+		grids[i]->UpdateDisplay();
+	});
+}
+
+// grid memory methods
+DENDRO_API void DendroCompact(DendroGrid * grid, double halfWidth)
+{
+	grid->Compact(halfWidth);
+}
+
+DENDRO_API void DendroSetMemoryBudget(long long bytes)
+{
+	DendroMemory::Instance().SetBudget((bytes > 0) ? static_cast<size_t>(bytes) : 0);
+}
+
+DENDRO_API long long DendroMemoryUsage()
+{
+	return static_cast<long long>(DendroMemory::Instance().Usage());
+}
+
+// grid result cache methods
+DENDRO_API unsigned long long DendroHash(DendroGrid * grid)
+{
+	return static_cast<unsigned long long>(grid->Hash());
+}
+
+DENDRO_API void DendroCacheSetCapacity(int entries)
+{
+	DendroCache::Instance().SetCapacity(entries);
+}
+
+DENDRO_API void DendroCacheClear()
+{
+	DendroCache::Instance().Clear();
+}
+
+DENDRO_API void DendroCacheStats(long long * hits, long long * misses)
+{
+	*hits = static_cast<long long>(DendroCache::Instance().Hits());
+	*misses = static_cast<long long>(DendroCache::Instance().Misses());
+}
+
+DENDRO_API void DendroSetFilterEngine(int engine)
+{
+	DendroFilter::SetEngine(engine);
+}
+
+DENDRO_API int DendroFilterInstructions()
+{
+	return DendroFilter::ActiveInstructions();
+}
+
+DENDRO_API void DendroSetSweepThreshold(double voxels)
+{
+	DendroFilter::SetSweepThreshold(voxels);
+}
+
+DENDRO_API void DendroTraceBegin()
+{
+	DendroTrace::Instance().Begin();
+}
+
+DENDRO_API bool DendroTraceEnd(const char * vFile)
+{
+	return DendroTrace::Instance().End(vFile);
+}
+
 // volume utilities
 DENDRO_API float* DendroClosestPoint(DendroGrid* grid, float* vPoints, int vCount, int* rSize)
 {
@@ -252,4 +497,35 @@ DENDRO_API float* DendroClosestPoint(DendroGrid* grid, float* vPoints, int vCoun
 	}
 
 	return pArray;
+}
+
+DENDRO_API float* DendroSlice(DendroGrid * grid, double * plane, int pCount, double spacing, int count, double isovalue, int * vSize, int ** contours, int * cSize)
+{
+	*vSize = 0;
+	*cSize = 0;
+	*contours = nullptr;
+
+	if (pCount != 6) {
+		return nullptr;
+	}
+
+	std::vector<float> vertices;
+	std::vector<int> loops;
+
+	grid->Slice(openvdb::Vec3d(plane[0], plane[1], plane[2]), openvdb::Vec3d(plane[3], plane[4], plane[5]), spacing, count, isovalue, vertices, loops);
+
+	if (vertices.empty()) {
+		return nullptr;
+	}
+
+	*vSize = static_cast<int>(vertices.size());
+	*cSize = static_cast<int>(loops.size());
+
+	float* vArray = reinterpret_cast<float*>(malloc(vertices.size() * sizeof(float)));
+	std::copy(vertices.begin(), vertices.end(), vArray);
+
+	*contours = reinterpret_cast<int*>(malloc(loops.size() * sizeof(int)));
+	std::copy(loops.begin(), loops.end(), *contours);
+
+	return vArray;
 }
\ No newline at end of file
@@ -31,12 +31,41 @@ extern "C" {
 	extern DENDRO_API bool DendroFromPoints(DendroGrid * grid, double *vPoints, int pCount, double *vRadius, int rCount, double voxelSize, double bandwidth);
 	extern DENDRO_API bool DendroFromMesh(DendroGrid * grid, float* vPoints, int vCount, int * vFaces, int fCount, double voxelSize, double bandwidth);
 
+	// analytic primitive constructors, matrix is the 16 value local to world transform of the primitive
+	extern DENDRO_API bool DendroFromSphere(DendroGrid * grid, double * matrix, int mCount, double radius, double voxelSize, double bandwidth);
+	extern DENDRO_API bool DendroFromBox(DendroGrid * grid, double * matrix, int mCount, double x, double y, double z, double voxelSize, double bandwidth);
+	extern DENDRO_API bool DendroFromCylinder(DendroGrid * grid, double * matrix, int mCount, double radius, double height, double voxelSize, double bandwidth);
+	extern DENDRO_API bool DendroFromTorus(DendroGrid * grid, double * matrix, int mCount, double majorRadius, double minorRadius, double voxelSize, double bandwidth);
+	extern DENDRO_API bool DendroFromCapsule(DendroGrid * grid, double * matrix, int mCount, double radius, double height, double voxelSize, double bandwidth);
+
 	// volume render methods
 	extern DENDRO_API void DendroToMesh(DendroGrid * grid);
 	extern DENDRO_API void DendroToMeshSettings(DendroGrid * grid, double isovalue, double adaptivity);
+	extern DENDRO_API void DendroToMeshDecimate(DendroGrid * grid, double isovalue, double adaptivity, int targetFaces, double maxError);
 
 	extern DENDRO_API float* DendroVertexBuffer(DendroGrid * grid, int* size);
 	extern DENDRO_API int* DendroFaceBuffer(DendroGrid * grid, int* size);
+	extern DENDRO_API float* DendroNormalBuffer(DendroGrid * grid, int* size);
+
+	// meshes the grid into new buffers without touching its display mesh, so any number of threads
+	// can mesh one grid at once. the caller frees all three buffers
+	extern DENDRO_API void DendroToMeshBuffers(DendroGrid * grid, double isovalue, double adaptivity, int targetFaces, double maxError, float** vertices, int* vSize, int** faces, int* fSize, float** normals, int* nSize);
+
+	// streams a mesh straight to a binary stl (0), binary ply (1) or obj (2) file without building it
+	// in memory first
+	extern DENDRO_API bool DendroExportMesh(DendroGrid * grid, const char * path, int format, double isovalue, double adaptivity);
+
+	// copies a box (min xyz, max xyz) between the grid and a caller owned float array in place. strides
+	// are in floats per x, y and z step and may be null for a packed x fastest array. every step voxels
+	// make one sample. calling with a null buffer only fills dims with the samples per axis
+	extern DENDRO_API bool DendroToDense(DendroGrid * grid, double * bbox, int bCount, bool world, int step, float * buffer, long long * strides, int * dims);
+
+	// writes the array back into the box, values past the threshold are dropped and a level set gets
+	// its narrow band rebuilt. a non-positive threshold keeps every band or density value
+	extern DENDRO_API bool DendroFromDense(DendroGrid * grid, double * bbox, int bCount, bool world, int step, float * buffer, long long * strides, double threshold);
+	// replaces the grid with a new level set, or fog volume when levelSet is false, of the given voxel size.
+	// size is the buffer length in floats and has to cover the box
+	extern DENDRO_API bool DendroFromDenseCreate(DendroGrid * grid, double * bbox, int bCount, bool world, int step, float * buffer, long long size, long long * strides, double threshold, double voxelSize, double bandwidth, bool levelSet);
 
 	// volume transformation methods
 	extern DENDRO_API bool DendroTransform(DendroGrid * grid, double* matrix, int mCount);
@@ -46,6 +75,12 @@ extern "C" {
 	extern DENDRO_API void DendroDifference(DendroGrid * grid, DendroGrid * csgGrid);
 	extern DENDRO_API void DendroIntersection(DendroGrid * grid, DendroGrid * csgGrid);
 
+	// csg with the seam filleted over radius world units. kernel 0 is a polynomial smooth minimum and
+	// 1 exponential, only voxels where both bands overlap are changed
+	extern DENDRO_API void DendroSmoothUnion(DendroGrid * grid, DendroGrid * csgGrid, double radius, int kernel);
+	extern DENDRO_API void DendroSmoothDifference(DendroGrid * grid, DendroGrid * csgGrid, double radius, int kernel);
+	extern DENDRO_API void DendroSmoothIntersection(DendroGrid * grid, DendroGrid * csgGrid, double radius, int kernel);
+
 	// volume filter methods
 	extern DENDRO_API void DendroOffset(DendroGrid * grid, double amount);
 	extern DENDRO_API void DendroOffsetMask(DendroGrid * grid, double amount, DendroGrid * mask, double min, double max, bool invert);
@@ -54,9 +89,45 @@ extern "C" {
 	extern DENDRO_API void DendroBlend(DendroGrid * bGrid, DendroGrid * eGrid, double bPosition, double bEnd);
 	extern DENDRO_API void DendroBlendMask(DendroGrid * bGrid, DendroGrid * eGrid, double bPosition, double bEnd, DendroGrid * mask, double min, double max, bool invert);
 
+	// batch methods, grids must be distinct handles. parameter arrays hold one value per grid or a single shared
+	// value, any other count is rejected and nothing is run
+	extern DENDRO_API bool DendroOffsetBatch(DendroGrid ** grids, int gCount, double * amounts, int aCount);
+	extern DENDRO_API bool DendroSmoothBatch(DendroGrid ** grids, int gCount, int * types, int * iterations, int * widths, int pCount);
+	extern DENDRO_API void DendroToMeshBatch(DendroGrid ** grids, int gCount, double isovalue, double adaptivity, int targetFaces, double maxError);
+	extern DENDRO_API void DendroToMeshDefaultBatch(DendroGrid ** grids, int gCount);
+
+	// memory methods, a budget of zero leaves memory unbounded. once the budget is reached cached results
+	// are dropped first, then display meshes already read back, then idle grids are compacted once each
+	extern DENDRO_API void DendroCompact(DendroGrid * grid, double halfWidth);
+	extern DENDRO_API void DendroSetMemoryBudget(long long bytes);
+	extern DENDRO_API long long DendroMemoryUsage();
+
+	// result cache methods, a capacity of zero disables caching
+	extern DENDRO_API unsigned long long DendroHash(DendroGrid * grid);
+	extern DENDRO_API void DendroCacheSetCapacity(int entries);
+	extern DENDRO_API void DendroCacheClear();
+	extern DENDRO_API void DendroCacheStats(long long * hits, long long * misses);
+
+	// filter engine methods, 0 runs mean and gaussian smoothing through openvdb and 1 through the dense
+	// block engine. instructions reports the kernel in use, 0 scalar, 1 avx2, 2 avx-512
+	extern DENDRO_API void DendroSetFilterEngine(int engine);
+	extern DENDRO_API int DendroFilterInstructions();
+
+	// offsets of more than this many voxels dilate the band and fast sweep instead of tracking the front,
+	// a negative threshold always tracks
+	extern DENDRO_API void DendroSetSweepThreshold(double voxels);
+
+	// tracing methods, spans recorded between begin and end are written as chrome trace-event json
+	extern DENDRO_API void DendroTraceBegin();
+	extern DENDRO_API bool DendroTraceEnd(const char * vFile);
+
 	// utilities and analysis
 	extern DENDRO_API float* DendroClosestPoint(DendroGrid* grid, float* vPoints, int vCount, int* rSize);
 
+	// planar sections, plane holds the origin then the normal of the first slice. returns closed contour
+	// vertices as xyz triples, contours gets a slice index and vertex count per loop
+	extern DENDRO_API float* DendroSlice(DendroGrid * grid, double * plane, int pCount, double spacing, int count, double isovalue, int * vSize, int ** contours, int * cSize);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,613 @@
+// DendroCLI.cpp : headless runner for batch volume pipelines described in json
+//
+// usage: dendro-cli pipeline.json [input ...]
+//
+// {
+//     "jobs": 2,                 concurrent jobs
+//     "threads": 16,             total thread budget
+//     "threadsPerJob": 8,        defaults to threads split evenly between jobs
+//     "voxelSize": 0.1,          used when converting meshes and points
+//     "bandwidth": 3,
+//     "radius": 1.0,             point radius when a point file has none
+//     "trace": "timeline.json",  optional chrome trace of every grid operation
+//     "filterEngine": "dense",   dense block mean and gaussian smoothing instead of openvdb
+//     "sweepThreshold": 4,       offsets past this many voxels are fast swept, negative to always track
+//     "inputs": [ "a.obj", "b.stl", "c.vdb", "d.xyz" ],
+//     "steps": [
+//         { "op": "union", "file": "tool.vdb", "blend": 0.2 },
+//         { "op": "offset", "amount": 0.5 },
+//         { "op": "smooth", "type": 1, "iterations": 2, "width": 1 },
+//         { "op": "mesh", "isovalue": 0, "adaptivity": 0.1 },
+//         { "op": "write", "file": "out/{name}.obj" }
+//     ]
+// }
+//
+// inputs given on the command line replace the ones in the pipeline. inputs are .vdb, .obj, .stl or
+// point files (.xyz, .csv, .txt, .pts), outputs .vdb, .obj, .stl or .ply. writing .stl or .ply streams
+// the mesh straight from the grid, taking "isovalue" and "adaptivity" from the write step
+
+#include "DendroGrid.h"
+#include "DendroExport.h"
+#include "DendroTrace.h"
+#include "DendroFilter.h"
+
+#include <openvdb/util/Util.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	typedef boost::property_tree::ptree Config;
+
+	struct Settings {
+		double voxelSize;
+		double bandwidth;
+		double radius;
+	};
+
+	struct Timing {
+		std::string stage;
+		double seconds;
+	};
+
+	struct Job {
+		std::string input;
+		std::vector<Timing> timings;
+		bool succeeded;
+		std::string error;
+	};
+
+	std::string Extension(const std::string& path)
+	{
+		std::string ext = std::filesystem::path(path).extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return ext;
+	}
+
+	// replaces {name} with the file name of the input without its extension
+	std::string Expand(std::string pattern, const std::string& input)
+	{
+		const std::string token = "{name}";
+		const std::string name = std::filesystem::path(input).stem().string();
+
+		size_t pos = pattern.find(token);
+		while (pos != std::string::npos) {
+			pattern.replace(pos, token.size(), name);
+			pos = pattern.find(token, pos + name.size());
+		}
+
+		return pattern;
+	}
+
+	void AddTriangle(std::vector<openvdb::Vec3s>& vertices, std::vector<openvdb::Vec4I>& faces, const openvdb::Vec3s& a, const openvdb::Vec3s& b, const openvdb::Vec3s& c)
+	{
+		openvdb::Index32 base = static_cast<openvdb::Index32>(vertices.size());
+		vertices.push_back(a);
+		vertices.push_back(b);
+		vertices.push_back(c);
+		faces.push_back(openvdb::Vec4I(base, base + 1, base + 2, openvdb::util::INVALID_IDX));
+	}
+
+	bool ReadObj(const std::string& path, double voxelSize, DendroMesh& mesh)
+	{
+		std::ifstream file(path);
+		if (!file) {
+			return false;
+		}
+
+		// vertices go into index space, same as DendroFromMesh
+		float inverseVoxelSize = static_cast<float>(1.0 / voxelSize);
+
+		std::vector<openvdb::Vec3s> vertices;
+		std::vector<openvdb::Vec4I> faces;
+
+		std::string line;
+		while (std::getline(file, line)) {
+			std::istringstream stream(line);
+			std::string tag;
+			stream >> tag;
+
+			if (tag == "v") {
+				float x = 0, y = 0, z = 0;
+				stream >> x >> y >> z;
+				vertices.push_back(openvdb::Vec3s(x, y, z) * inverseVoxelSize);
+			}
+			else if (tag == "f") {
+				// corners look like v, v/t, v//n or v/t/n and may be negative
+				std::vector<openvdb::Index32> corners;
+				std::string corner;
+				while (stream >> corner) {
+					long index = std::stol(corner.substr(0, corner.find('/')));
+					index = (index < 0) ? static_cast<long>(vertices.size()) + index : index - 1;
+					corners.push_back(static_cast<openvdb::Index32>(index));
+				}
+
+				if (corners.size() == 4) {
+					faces.push_back(openvdb::Vec4I(corners[0], corners[1], corners[2], corners[3]));
+				}
+				else {
+					// fan anything else into triangles
+					for (size_t i = 2; i < corners.size(); i++) {
+						faces.push_back(openvdb::Vec4I(corners[0], corners[i - 1], corners[i], openvdb::util::INVALID_IDX));
+					}
+				}
+			}
+		}
+
+		mesh.AddVertice(vertices);
+		mesh.AddFace(faces);
+
+		return mesh.IsValid();
+	}
+
+	bool ReadStl(const std::string& path, double voxelSize, DendroMesh& mesh)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+
+		float inverseVoxelSize = static_cast<float>(1.0 / voxelSize);
+
+		// stl repeats shared corners, meshToVolume does not need them welded
+		std::vector<openvdb::Vec3s> vertices;
+		std::vector<openvdb::Vec4I> faces;
+
+		file.seekg(0, std::ios::end);
+		std::streamoff size = file.tellg();
+		file.seekg(0, std::ios::beg);
+
+		// binary files are identified by their size, some exporters write "solid" in the header anyway
+		char header[80] = {};
+		uint32_t count = 0;
+		file.read(header, 80);
+		file.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+		if (file && size == 84 + static_cast<std::streamoff>(count) * 50) {
+			for (uint32_t i = 0; i < count; i++) {
+				float values[12];
+				char attribute[2];
+				file.read(reinterpret_cast<char*>(values), sizeof(values));
+				file.read(attribute, sizeof(attribute));
+
+				AddTriangle(vertices, faces,
+					openvdb::Vec3s(values[3], values[4], values[5]) * inverseVoxelSize,
+					openvdb::Vec3s(values[6], values[7], values[8]) * inverseVoxelSize,
+					openvdb::Vec3s(values[9], values[10], values[11]) * inverseVoxelSize);
+			}
+		}
+		else {
+			file.clear();
+			file.seekg(0, std::ios::beg);
+
+			std::vector<openvdb::Vec3s> corners;
+			std::string token;
+			while (file >> token) {
+				if (token == "vertex") {
+					float x = 0, y = 0, z = 0;
+					file >> x >> y >> z;
+					corners.push_back(openvdb::Vec3s(x, y, z) * inverseVoxelSize);
+				}
+				else if (token == "endloop") {
+					if (corners.size() >= 3) {
+						AddTriangle(vertices, faces, corners[0], corners[1], corners[2]);
+					}
+					corners.clear();
+				}
+			}
+		}
+
+		mesh.AddVertice(vertices);
+		mesh.AddFace(faces);
+
+		return mesh.IsValid();
+	}
+
+	// one point per line as x y z with an optional radius, commas are treated as spaces
+	bool ReadPoints(const std::string& path, double radius, DendroParticle& points)
+	{
+		std::ifstream file(path);
+		if (!file) {
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(file, line)) {
+			std::replace(line.begin(), line.end(), ',', ' ');
+			std::istringstream stream(line);
+
+			double x, y, z;
+			if (!(stream >> x >> y >> z)) {
+				continue;
+			}
+
+			double r;
+			if (!(stream >> r)) {
+				r = radius;
+			}
+
+			points.add(openvdb::Vec3R(x, y, z), openvdb::Real(r));
+		}
+
+		return points.IsValid();
+	}
+
+	bool Load(DendroGrid& grid, const std::string& path, const Settings& settings)
+	{
+		std::string ext = Extension(path);
+
+		if (ext == ".vdb") {
+			return grid.Read(path.c_str());
+		}
+
+		if (ext == ".obj" || ext == ".stl") {
+			DendroMesh mesh;
+			bool read = (ext == ".obj") ? ReadObj(path, settings.voxelSize, mesh) : ReadStl(path, settings.voxelSize, mesh);
+			return read && grid.CreateFromMesh(mesh, settings.voxelSize, settings.bandwidth);
+		}
+
+		if (ext == ".xyz" || ext == ".csv" || ext == ".txt" || ext == ".pts") {
+			DendroParticle points;
+			return ReadPoints(path, settings.radius, points) && grid.CreateFromPoints(points, settings.voxelSize, settings.bandwidth);
+		}
+
+		throw std::runtime_error("unsupported input format " + path);
+	}
+
+	bool WriteObj(DendroMesh mesh, const std::string& path)
+	{
+		std::ofstream file(path);
+		if (!file) {
+			return false;
+		}
+
+		auto vertices = mesh.Vertices();
+		auto faces = mesh.Faces();
+
+		for (auto it = vertices.begin(); it != vertices.end(); ++it) {
+			file << "v " << it->x() << " " << it->y() << " " << it->z() << "\n";
+		}
+
+		for (auto it = faces.begin(); it != faces.end(); ++it) {
+			file << "f " << it->x() + 1 << " " << it->y() + 1 << " " << it->z() + 1;
+			if (it->w() != openvdb::util::INVALID_IDX) {
+				file << " " << it->w() + 1;
+			}
+			file << "\n";
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	// csg operands are loaded once and shared read-only between jobs
+	class Operands
+	{
+	public:
+		explicit Operands(const Settings& settings) : mSettings(settings) {}
+
+		std::shared_ptr<DendroGrid> Get(const std::string& path)
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+
+			auto it = mGrids.find(path);
+			if (it != mGrids.end()) {
+				return it->second;
+			}
+
+			auto grid = std::make_shared<DendroGrid>();
+			if (!Load(*grid, path, mSettings)) {
+				throw std::runtime_error("unable to read operand " + path);
+			}
+
+			// hash up front so jobs never race to fill it in
+			grid->Hash();
+
+			mGrids[path] = grid;
+			return grid;
+		}
+
+	private:
+		Settings mSettings;
+		std::mutex mMutex;
+		std::map<std::string, std::shared_ptr<DendroGrid>> mGrids;
+	};
+
+	template<typename StageT>
+	void Timed(Job& job, const std::string& stage, StageT stageFn)
+	{
+		auto start = std::chrono::steady_clock::now();
+		stageFn();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		Timing timing;
+		timing.stage = stage;
+		timing.seconds = elapsed.count();
+		job.timings.push_back(timing);
+	}
+
+	void RunStep(DendroGrid& grid, const Config& step, const std::string& input, Operands& operands, bool& meshed)
+	{
+		std::string op = step.get<std::string>("op");
+
+		if (op == "union" || op == "intersection" || op == "difference") {
+			auto operand = operands.Get(step.get<std::string>("file"));
+
+			// a blend radius fillets the seam, "kernel" picks polynomial or exponential
+			const double blend = step.get<double>("blend", 0.0);
+			const int kernel = (step.get<std::string>("kernel", "polynomial") == "exponential") ? DendroGrid::EXPONENTIAL : DendroGrid::POLYNOMIAL;
+
+			if (op == "union") {
+				if (blend > 0.0) {
+					grid.BooleanUnion(*operand, blend, kernel);
+				}
+				else {
+					grid.BooleanUnion(*operand);
+				}
+			}
+			else if (op == "intersection") {
+				if (blend > 0.0) {
+					grid.BooleanIntersection(*operand, blend, kernel);
+				}
+				else {
+					grid.BooleanIntersection(*operand);
+				}
+			}
+			else {
+				if (blend > 0.0) {
+					grid.BooleanDifference(*operand, blend, kernel);
+				}
+				else {
+					grid.BooleanDifference(*operand);
+				}
+			}
+			meshed = false;
+		}
+		else if (op == "offset") {
+			grid.Offset(step.get<double>("amount"));
+			meshed = false;
+		}
+		else if (op == "smooth") {
+			grid.Smooth(step.get<int>("type", 1), step.get<int>("iterations", 1), step.get<int>("width", 1));
+			meshed = false;
+		}
+		else if (op == "compact") {
+			// compacting frees the display mesh
+			grid.Compact(step.get<double>("halfWidth", 0.0));
+			meshed = false;
+		}
+		else if (op == "mesh") {
+			grid.UpdateDisplay(
+				step.get<double>("isovalue", 0.0),
+				step.get<double>("adaptivity", 0.0),
+				step.get<int>("faces", 0),
+				step.get<double>("error", 0.0));
+			meshed = true;
+		}
+		else if (op == "write") {
+			std::string path = Expand(step.get<std::string>("file"), input);
+
+			std::filesystem::path parent = std::filesystem::path(path).parent_path();
+			if (!parent.empty()) {
+				std::filesystem::create_directories(parent);
+			}
+
+			const std::string ext = Extension(path);
+
+			if (ext == ".stl" || ext == ".ply") {
+				const int format = (ext == ".stl") ? DendroExport::STL : DendroExport::PLY;
+				if (!grid.Export(path.c_str(), format, step.get<double>("isovalue", 0.0), step.get<double>("adaptivity", 0.0))) {
+					throw std::runtime_error("unable to write " + path);
+				}
+			}
+			else if (ext == ".obj") {
+				if (!meshed) {
+					grid.UpdateDisplay();
+					meshed = true;
+				}
+				if (!WriteObj(grid.Display(), path)) {
+					throw std::runtime_error("unable to write " + path);
+				}
+			}
+			else if (ext == ".vdb") {
+				grid.Write(path.c_str());
+			}
+			else {
+				throw std::runtime_error("unsupported output format " + path);
+			}
+		}
+		else {
+			throw std::runtime_error("unknown step " + op);
+		}
+	}
+
+	void RunJob(Job& job, const Config& steps, const Settings& settings, Operands& operands)
+	{
+		try {
+			DendroGrid grid;
+			bool meshed = false;
+
+			Timed(job, "read", [&]() {
+				if (!Load(grid, job.input, settings)) {
+					throw std::runtime_error("unable to read " + job.input);
+				}
+			});
+
+			for (auto it = steps.begin(); it != steps.end(); ++it) {
+				const Config& step = it->second;
+				Timed(job, step.get<std::string>("op"), [&]() { RunStep(grid, step, job.input, operands, meshed); });
+			}
+
+			job.succeeded = true;
+		}
+		catch (const std::exception& e) {
+			job.succeeded = false;
+			job.error = e.what();
+		}
+	}
+
+	void Report(const Job& job, std::mutex& outputMutex)
+	{
+		std::ostringstream line;
+		line << (job.succeeded ? "[ok]   " : "[fail] ") << job.input;
+
+		double total = 0.0;
+		for (auto it = job.timings.begin(); it != job.timings.end(); ++it) {
+			line << "  " << it->stage << " " << it->seconds << "s";
+			total += it->seconds;
+		}
+		line << "  total " << total << "s";
+
+		if (!job.succeeded) {
+			line << "  (" << job.error << ")";
+		}
+
+		std::lock_guard<std::mutex> lock(outputMutex);
+		std::cout << line.str() << std::endl;
+	}
+
+	void Summarize(const std::vector<Job>& jobs, double wall)
+	{
+		// stage totals in the order stages first appear
+		std::vector<std::string> order;
+		std::map<std::string, std::pair<double, int>> stages;
+
+		int failed = 0;
+		for (auto job = jobs.begin(); job != jobs.end(); ++job) {
+			failed += job->succeeded ? 0 : 1;
+			for (auto it = job->timings.begin(); it != job->timings.end(); ++it) {
+				if (stages.find(it->stage) == stages.end()) {
+					order.push_back(it->stage);
+				}
+				stages[it->stage].first += it->seconds;
+				stages[it->stage].second++;
+			}
+		}
+
+		std::printf("\n%-14s %8s %12s %12s\n", "stage", "runs", "total (s)", "mean (s)");
+		for (auto it = order.begin(); it != order.end(); ++it) {
+			const auto& stage = stages[*it];
+			std::printf("%-14s %8d %12.3f %12.3f\n", it->c_str(), stage.second, stage.first, stage.first / stage.second);
+		}
+
+		std::printf("\n%d jobs, %d failed, %.3fs wall\n", static_cast<int>(jobs.size()), failed, wall);
+	}
+
+}
+
+int main(int argc, char * argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: dendro-cli pipeline.json [input ...]" << std::endl;
+		return 2;
+	}
+
+	Config pipeline;
+	try {
+		boost::property_tree::read_json(argv[1], pipeline);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "unable to read pipeline: " << e.what() << std::endl;
+		return 2;
+	}
+
+	Settings settings;
+	settings.voxelSize = pipeline.get<double>("voxelSize", 0.1);
+	settings.bandwidth = pipeline.get<double>("bandwidth", 3.0);
+	settings.radius = pipeline.get<double>("radius", 1.0);
+
+	std::vector<Job> jobs;
+	if (argc > 2) {
+		for (int i = 2; i < argc; i++) {
+			jobs.push_back(Job{ argv[i], {}, false, "" });
+		}
+	}
+	else {
+		for (auto& input : pipeline.get_child("inputs", Config())) {
+			jobs.push_back(Job{ input.second.get_value<std::string>(), {}, false, "" });
+		}
+	}
+
+	if (jobs.empty()) {
+		std::cerr << "no inputs to process" << std::endl;
+		return 2;
+	}
+
+	const Config steps = pipeline.get_child("steps", Config());
+
+	int threads = pipeline.get<int>("threads", std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+	int concurrency = std::min(std::max(1, pipeline.get<int>("jobs", 1)), static_cast<int>(jobs.size()));
+	int threadsPerJob = std::max(1, pipeline.get<int>("threadsPerJob", threads / concurrency));
+
+	// the global limit caps everything, each job then works inside its own arena
+	tbb::global_control control(tbb::global_control::max_allowed_parallelism, static_cast<size_t>(threads));
+
+	if (pipeline.get<std::string>("filterEngine", "openvdb") == "dense") {
+		DendroFilter::SetEngine(DendroFilter::DENSE);
+	}
+
+	DendroFilter::SetSweepThreshold(pipeline.get<double>("sweepThreshold", DendroFilter::SweepThreshold()));
+
+	std::string trace = pipeline.get<std::string>("trace", "");
+	if (!trace.empty()) {
+		DendroTrace::Instance().Begin();
+	}
+
+	Operands operands(settings);
+	std::mutex outputMutex;
+	std::atomic<size_t> next(0);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (int w = 0; w < concurrency; w++) {
+		workers.emplace_back([&]() {
+			tbb::task_arena arena(threadsPerJob);
+
+			for (size_t i = next++; i < jobs.size(); i = next++) {
+				arena.execute([&]() { RunJob(jobs[i], steps, settings, operands); });
+				Report(jobs[i], outputMutex);
+			}
+		});
+	}
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+
+	std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+	Summarize(jobs, wall.count());
+
+	if (!trace.empty() && !DendroTrace::Instance().End(trace.c_str())) {
+		std::cerr << "unable to write trace " << trace << std::endl;
+	}
+
+	for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+		if (!it->succeeded) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
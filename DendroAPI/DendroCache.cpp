@@ -0,0 +1,252 @@
+#include "stdafx.h"
+#include "DendroCache.h"
+
+#include <openvdb/tree/LeafManager.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <cstring>
+
+namespace {
+
+	// 64-bit finalizer from murmur3, spreads every input bit across the result
+	inline uint64_t Mix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	inline uint64_t Combine(uint64_t seed, uint64_t value)
+	{
+		return Mix(seed ^ (Mix(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+	}
+
+	inline uint64_t Bits(double value)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline uint64_t Bits(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline uint64_t HashCoord(const openvdb::Coord& c)
+	{
+		return Combine(Combine(static_cast<uint32_t>(c.x()), static_cast<uint32_t>(c.y())), static_cast<uint32_t>(c.z()));
+	}
+}
+
+bool DendroCache::Key::operator==(const Key& k) const
+{
+	return operation == k.operation && inputs == k.inputs && parameters == k.parameters;
+}
+
+size_t DendroCache::KeyHash::operator()(const Key& k) const
+{
+	uint64_t h = Mix(static_cast<uint64_t>(k.operation));
+	for (auto it = k.inputs.begin(); it != k.inputs.end(); ++it) {
+		h = Combine(h, *it);
+	}
+	for (auto it = k.parameters.begin(); it != k.parameters.end(); ++it) {
+		h = Combine(h, Bits(*it));
+	}
+	return static_cast<size_t>(h);
+}
+
+DendroCache& DendroCache::Instance()
+{
+	static DendroCache instance;
+	return instance;
+}
+
+DendroCache::DendroCache() : mCapacity(16), mHits(0), mMisses(0)
+{
+}
+
+uint64_t DendroCache::HashGrid(const openvdb::FloatGrid& grid)
+{
+	using openvdb::Index64;
+
+	// leaves are hashed independently in parallel and folded in tree order, so the
+	// root hash only depends on leaf contents and their position in the tree
+	openvdb::tree::LeafManager<const openvdb::FloatTree> leafs(grid.tree());
+	std::vector<uint64_t> leafHashes(leafs.leafCount());
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, leafs.leafCount()), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			const openvdb::FloatTree::LeafNodeType& leaf = leafs.leaf(n);
+
+			uint64_t h = HashCoord(leaf.origin());
+
+			const auto& mask = leaf.getValueMask();
+			for (openvdb::Index i = 0; i < mask.WORD_COUNT; i++) {
+				h = Combine(h, mask.template getWord<Index64>(i));
+			}
+
+			const float *values = leaf.buffer().data();
+			for (openvdb::Index i = 0; i < openvdb::FloatTree::LeafNodeType::SIZE; i += 2) {
+				h = Combine(h, (Bits(values[i]) << 32) | Bits(values[i + 1]));
+			}
+
+			leafHashes[n] = h;
+		}
+	});
+
+	uint64_t h = Mix(static_cast<uint64_t>(grid.getGridClass()));
+	h = Combine(h, Bits(grid.background()));
+
+	const openvdb::Mat4d xform = grid.transform().baseMap()->getAffineMap()->getMat4();
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			h = Combine(h, Bits(xform(i, j)));
+		}
+	}
+
+	// active tiles live above the leaf level and are not covered by the leaf hashes
+	openvdb::FloatTree::ValueOnCIter tile = grid.tree().cbeginValueOn();
+	tile.setMaxDepth(openvdb::FloatTree::ValueOnCIter::LEAF_DEPTH - 1);
+	for (; tile; ++tile) {
+		h = Combine(Combine(h, HashCoord(tile.getCoord())), Bits(*tile));
+	}
+
+	for (auto it = leafHashes.begin(); it != leafHashes.end(); ++it) {
+		h = Combine(h, *it);
+	}
+
+	return h;
+}
+
+bool DendroCache::Enabled()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCapacity > 0;
+}
+
+openvdb::FloatGrid::Ptr DendroCache::Find(const Key& key)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mLookup.find(key);
+	if (it == mLookup.end()) {
+		mMisses++;
+		return openvdb::FloatGrid::Ptr();
+	}
+
+	// move the hit to the front of the recently used list
+	mEntries.splice(mEntries.begin(), mEntries, it->second);
+	mHits++;
+
+	return it->second->grid;
+}
+
+void DendroCache::Insert(const Key& key, openvdb::FloatGrid::Ptr grid)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (mCapacity == 0 || !grid) {
+		return;
+	}
+
+	// cached grids are never edited in place, so their size is measured once
+	const size_t bytes = static_cast<size_t>(grid->memUsage());
+
+	auto it = mLookup.find(key);
+	if (it != mLookup.end()) {
+		it->second->grid = grid;
+		it->second->bytes = bytes;
+		mEntries.splice(mEntries.begin(), mEntries, it->second);
+		return;
+	}
+
+	Entry entry;
+	entry.key = key;
+	entry.grid = grid;
+	entry.bytes = bytes;
+
+	mEntries.push_front(entry);
+	mLookup[key] = mEntries.begin();
+
+	while (mEntries.size() > mCapacity) {
+		mLookup.erase(mEntries.back().key);
+		mEntries.pop_back();
+	}
+}
+
+void DendroCache::SetCapacity(int entries)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mCapacity = (entries > 0) ? static_cast<size_t>(entries) : 0;
+
+	while (mEntries.size() > mCapacity) {
+		mLookup.erase(mEntries.back().key);
+		mEntries.pop_back();
+	}
+}
+
+void DendroCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mEntries.clear();
+	mLookup.clear();
+	mHits = 0;
+	mMisses = 0;
+}
+
+size_t DendroCache::Bytes()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// a grid still held by a live grid is already counted there
+	size_t bytes = 0;
+	for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+		if (it->grid.use_count() == 1) {
+			bytes += it->bytes;
+		}
+	}
+
+	return bytes;
+}
+
+size_t DendroCache::Trim(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// least recently used first, dropping shared entries would free nothing
+	size_t freed = 0;
+	for (auto it = mEntries.end(); it != mEntries.begin() && freed < bytes;) {
+		--it;
+		if (it->grid.use_count() != 1) {
+			continue;
+		}
+
+		freed += it->bytes;
+		mLookup.erase(it->key);
+		it = mEntries.erase(it);
+	}
+
+	return freed;
+}
+
+uint64_t DendroCache::Hits()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mHits;
+}
+
+uint64_t DendroCache::Misses()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMisses;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#ifndef __DENDROCACHE_H__
+#define __DENDROCACHE_H__
+
+#include <openvdb/openvdb.h>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class DendroCache
+{
+public:
+	enum Operation {
+		UNION = 0,
+		INTERSECTION,
+		DIFFERENCE,
+		OFFSET,
+		OFFSET_MASK,
+		SMOOTH,
+		SMOOTH_MASK,
+		BLEND,
+		BLEND_MASK
+	};
+
+	// an operation, the content hashes of its input grids, and its parameters
+	struct Key {
+		int operation;
+		std::vector<uint64_t> inputs;
+		std::vector<double> parameters;
+
+		bool operator==(const Key& k) const;
+	};
+
+	static DendroCache& Instance();
+
+	// content hash over the transform, background, active tiles, and every leaf node of a grid
+	static uint64_t HashGrid(const openvdb::FloatGrid& grid);
+
+	bool Enabled();
+	openvdb::FloatGrid::Ptr Find(const Key& key);
+	void Insert(const Key& key, openvdb::FloatGrid::Ptr grid);
+
+	void SetCapacity(int entries);
+	void Clear();
+
+	// bytes of cached grids no live grid shares, which the memory budget counts on top of the grids
+	size_t Bytes();
+
+	// drops least recently used entries no live grid shares until at least the given bytes are
+	// freed, returns the bytes actually freed
+	size_t Trim(size_t bytes);
+
+	uint64_t Hits();
+	uint64_t Misses();
+
+private:
+	struct KeyHash {
+		size_t operator()(const Key& k) const;
+	};
+
+	struct Entry {
+		Key key;
+		openvdb::FloatGrid::Ptr grid;
+		size_t bytes;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	DendroCache();
+
+	std::mutex mMutex;
+	EntryList mEntries;
+	std::unordered_map<Key, EntryList::iterator, KeyHash> mLookup;
+	size_t mCapacity;
+	uint64_t mHits;
+	uint64_t mMisses;
+};
+
+#endif // __DENDROCACHE_H__
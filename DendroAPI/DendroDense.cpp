@@ -0,0 +1,162 @@
+#include "stdafx.h"
+#include "DendroDense.h"
+#include "DendroTrace.h"
+
+#include <openvdb/tools/Interpolation.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+	using LeafT = openvdb::FloatTree::LeafNodeType;
+
+	inline int LeafFloor(int v)
+	{
+		return (v >> LeafT::LOG2DIM) << LeafT::LOG2DIM;
+	}
+
+}
+
+DendroDense::DendroDense(const openvdb::CoordBBox& bbox, int step, const int64_t * strides) : mBBox(bbox), mStep(std::max(1, step))
+{
+	const openvdb::Coord dim = bbox.dim();
+	mDims = openvdb::Coord(
+		(dim.x() + mStep - 1) / mStep,
+		(dim.y() + mStep - 1) / mStep,
+		(dim.z() + mStep - 1) / mStep);
+
+	if (strides) {
+		mStrides[0] = strides[0];
+		mStrides[1] = strides[1];
+		mStrides[2] = strides[2];
+	}
+	else {
+		mStrides[0] = 1;
+		mStrides[1] = mDims.x();
+		mStrides[2] = int64_t(mDims.x()) * mDims.y();
+	}
+}
+
+openvdb::Coord DendroDense::Dims() const
+{
+	return mDims;
+}
+
+int64_t DendroDense::Extent() const
+{
+	int64_t lo = 0, hi = 0;
+	for (int a = 0; a < 3; a++) {
+		const int64_t reach = int64_t(mDims[a] - 1) * mStrides[a];
+		lo += std::min<int64_t>(reach, 0);
+		hi += std::max<int64_t>(reach, 0);
+	}
+
+	return (lo < 0) ? -1 : hi + 1;
+}
+
+int64_t DendroDense::Offset(int i, int j, int k) const
+{
+	return i * mStrides[0] + j * mStrides[1] + k * mStrides[2];
+}
+
+void DendroDense::Read(const openvdb::FloatGrid& grid, float * buffer) const
+{
+	DendroTrace::Span span("DendroDense::Read");
+
+	// odd steps put the block center on a voxel, even ones between voxels
+	const bool exact = (mStep % 2) == 1;
+	const double half = 0.5 * (mStep - 1);
+	const openvdb::Vec3d min = mBBox.min().asVec3d();
+
+	const int64_t rows = int64_t(mDims.y()) * mDims.z();
+
+	tbb::parallel_for(tbb::blocked_range<int64_t>(0, rows), [&](const tbb::blocked_range<int64_t>& r) {
+		// every task reads through its own accessor
+		auto acc = grid.getConstAccessor();
+
+		for (int64_t row = r.begin(); row < r.end(); row++) {
+			const int j = static_cast<int>(row % mDims.y());
+			const int k = static_cast<int>(row / mDims.y());
+
+			for (int i = 0; i < mDims.x(); i++) {
+				const openvdb::Vec3d p = min + openvdb::Vec3d(i, j, k) * double(mStep) + openvdb::Vec3d(half);
+				buffer[Offset(i, j, k)] = exact ? acc.getValue(openvdb::Coord::round(p)) : openvdb::tools::BoxSampler::sample(acc, p);
+			}
+		}
+	});
+}
+
+void DendroDense::Write(openvdb::FloatGrid& grid, const float * buffer, float threshold) const
+{
+	DendroTrace::Span span("DendroDense::Write");
+
+	const bool levelSet = grid.getGridClass() == openvdb::GRID_LEVEL_SET;
+	const float background = grid.background();
+
+	std::vector<openvdb::Coord> origins;
+	for (int x = LeafFloor(mBBox.min().x()); x <= mBBox.max().x(); x += LeafT::DIM) {
+		for (int y = LeafFloor(mBBox.min().y()); y <= mBBox.max().y(); y += LeafT::DIM) {
+			for (int z = LeafFloor(mBBox.min().z()); z <= mBBox.max().z(); z += LeafT::DIM) {
+				origins.push_back(openvdb::Coord(x, y, z));
+			}
+		}
+	}
+
+	// leaves are filled on their own in parallel and only handed to the tree afterwards, so no two
+	// threads ever write the same tree
+	std::vector<LeafT*> leaves(origins.size(), nullptr);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, origins.size()), [&](const tbb::blocked_range<size_t>& r) {
+		auto acc = grid.getConstAccessor();
+
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			const openvdb::Coord& origin = origins[n];
+
+			// voxels of a leaf past the box keep what the grid had there
+			LeafT *leaf = nullptr;
+			if (const LeafT *existing = acc.probeConstLeaf(origin)) {
+				leaf = new LeafT(*existing);
+			}
+			else {
+				leaf = new LeafT(origin, acc.getValue(origin), acc.isValueOn(origin));
+			}
+
+			const openvdb::Coord lo = openvdb::Coord::maxComponent(origin, mBBox.min());
+			const openvdb::Coord hi = openvdb::Coord::minComponent(origin.offsetBy(LeafT::DIM - 1), mBBox.max());
+
+			for (int x = lo.x(); x <= hi.x(); x++) {
+				for (int y = lo.y(); y <= hi.y(); y++) {
+					for (int z = lo.z(); z <= hi.z(); z++) {
+						const openvdb::Coord xyz(x, y, z);
+						const float value = buffer[Offset(
+							(x - mBBox.min().x()) / mStep,
+							(y - mBBox.min().y()) / mStep,
+							(z - mBBox.min().z()) / mStep)];
+
+						// level sets keep the band inside the threshold, fog volumes the density above it
+						const openvdb::Index offset = LeafT::coordToOffset(xyz);
+						if (levelSet ? std::abs(value) < threshold : value > threshold) {
+							leaf->setValueOn(offset, value);
+						}
+						else {
+							leaf->setValueOff(offset, (levelSet && value < 0.0f) ? -background : background);
+						}
+					}
+				}
+			}
+
+			leaves[n] = leaf;
+		}
+	});
+
+	DendroTrace::Span phase("add leaves");
+
+	for (auto it = leaves.begin(); it != leaves.end(); ++it) {
+		grid.tree().addLeaf(*it);
+	}
+}
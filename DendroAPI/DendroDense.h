@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef __DENDRODENSE_H__
+#define __DENDRODENSE_H__
+
+#define IMATH_HALF_NO_LOOKUP_TABLE
+
+#include <openvdb/openvdb.h>
+#include <cstdint>
+
+// copies an index space box between a sparse grid and a caller's strided float array, with no dense
+// grid in between. every step voxels along each axis make one sample, so step one is an exact copy
+class DendroDense
+{
+public:
+	// strides are in floats for x, y and z. without them samples are packed with x fastest
+	DendroDense(const openvdb::CoordBBox& bbox, int step, const int64_t * strides);
+
+	// samples along each axis
+	openvdb::Coord Dims() const;
+
+	// floats the buffer has to hold to cover every sample, -1 if a stride would reach before its start
+	int64_t Extent() const;
+
+	// fills the buffer from the grid, coarser samples are interpolated at the center of their block
+	void Read(const openvdb::FloatGrid& grid, float * buffer) const;
+
+	// copies the buffer into the grid, every sample filling its block. voxels on the wrong side of
+	// the threshold are left inactive at the background, so the caller can rebuild a clean band
+	void Write(openvdb::FloatGrid& grid, const float * buffer, float threshold) const;
+
+private:
+	int64_t Offset(int i, int j, int k) const;
+
+	openvdb::CoordBBox mBBox;
+	openvdb::Coord mDims;
+	int mStep;
+	int64_t mStrides[3];
+};
+
+#endif // __DENDRODENSE_H__
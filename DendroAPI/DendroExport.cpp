@@ -0,0 +1,548 @@
+#include "stdafx.h"
+#include "DendroExport.h"
+#include "DendroTrace.h"
+
+#include <openvdb/tools/Interpolation.h>
+#include <openvdb/tools/VolumeToMesh.h>
+#include <openvdb/util/Util.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <set>
+#include <string>
+
+namespace {
+
+	using LeafT = openvdb::FloatTree::LeafNodeType;
+
+	// regions are 128 voxels a side, small enough that a batch of them stays well under a gigabyte
+	const int REGION_LOG2 = 7;
+	const int REGION = 1 << REGION_LOG2;
+
+	// voxels copied past every region border. the margin holds whatever the region's own polygons
+	// reach into, and the false surface where the copy ends is too far out to ever be kept
+	const int MARGIN = LeafT::DIM;
+
+	// voxels inside every region border that are meshed without merging. polygons near a border are
+	// built only from these in both regions, so they come out identical
+	const int SEAM = 4;
+
+	const long STL_HEADER = 80;
+
+	inline int Corners(const openvdb::Vec4I& f)
+	{
+		return (f[3] == openvdb::util::INVALID_IDX) ? 3 : 4;
+	}
+
+	// drop repeated corners of a merged polygon, returns false if fewer than three remain
+	inline bool Collapse(openvdb::Vec4I& f)
+	{
+		openvdb::Index32 corners[4];
+		int count = 0;
+
+		const int fCount = Corners(f);
+		for (int i = 0; i < fCount; i++) {
+			if (count == 0 || corners[count - 1] != f[i]) {
+				corners[count++] = f[i];
+			}
+		}
+
+		if (count > 1 && corners[count - 1] == corners[0]) {
+			count--;
+		}
+
+		if (count < 3) {
+			return false;
+		}
+
+		f = openvdb::Vec4I(corners[0], corners[1], corners[2], (count == 4) ? corners[3] : openvdb::util::INVALID_IDX);
+		return true;
+	}
+
+	template<typename T>
+	inline void Append(std::vector<char>& bytes, const T& value)
+	{
+		const char *p = reinterpret_cast<const char*>(&value);
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+
+	inline void Append(std::vector<char>& bytes, const char * text, int length)
+	{
+		if (length > 0) {
+			bytes.insert(bytes.end(), text, text + length);
+		}
+	}
+
+	inline bool Put(std::FILE * file, const std::vector<char>& bytes)
+	{
+		return bytes.empty() || std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	}
+
+	// counts are fixed width so the header can be rewritten in place once they are known
+	std::string PlyHeader(uint64_t vertices, uint64_t faces)
+	{
+		char counts[2][32];
+		std::snprintf(counts[0], sizeof(counts[0]), "%010llu", static_cast<unsigned long long>(vertices));
+		std::snprintf(counts[1], sizeof(counts[1]), "%010llu", static_cast<unsigned long long>(faces));
+
+		return std::string("ply\n")
+			+ "format binary_little_endian 1.0\n"
+			+ "element vertex " + counts[0] + "\n"
+			+ "property float x\n"
+			+ "property float y\n"
+			+ "property float z\n"
+			+ "element face " + counts[1] + "\n"
+			+ "property list uchar uint vertex_indices\n"
+			+ "end_header\n";
+	}
+
+}
+
+bool DendroExport::SeamKey::operator==(const SeamKey& other) const
+{
+	return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+}
+
+size_t DendroExport::SeamHash::operator()(const SeamKey& key) const
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < 3; i++) {
+		hash = (hash ^ key.bits[i]) * 1099511628211ULL;
+	}
+	return static_cast<size_t>(hash);
+}
+
+DendroExport::DendroExport(const openvdb::FloatGrid& grid, double isovalue, double adaptivity) : mGrid(grid), mIsovalue(isovalue), mAdaptivity(adaptivity), mVertexCount(0)
+{
+}
+
+bool DendroExport::Write(const char * path, int format)
+{
+	DendroTrace::Span span("DendroExport::Write");
+
+	if (format < STL || format > OBJ) {
+		return false;
+	}
+
+	std::FILE *file = std::fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+
+	// ply faces have to follow every vertex, so they are spooled to a side file and appended last
+	const std::string spoolPath = std::string(path) + ".faces";
+	std::FILE *spool = NULL;
+	if (format == PLY) {
+		spool = std::fopen(spoolPath.c_str(), "w+b");
+		if (!spool) {
+			std::fclose(file);
+			std::remove(path);
+			return false;
+		}
+	}
+
+	mSeams.clear();
+	mVertexCount = 0;
+
+	// headers go out with placeholder counts and are rewritten at the end
+	bool ok = true;
+	if (format == STL) {
+		char header[STL_HEADER] = {};
+		std::strncpy(header, "binary stl exported by dendro", sizeof(header) - 1);
+		const uint32_t triangles = 0;
+		ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header) && std::fwrite(&triangles, sizeof(triangles), 1, file) == 1;
+	}
+	else if (format == PLY) {
+		const std::string header = PlyHeader(0, 0);
+		ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+	}
+
+	const std::vector<openvdb::Coord> regions = Regions();
+	const size_t batch = size_t(std::max(1, tbb::this_task_arena::max_concurrency()));
+
+	uint64_t faceCount = 0;
+
+	for (size_t start = 0; start < regions.size() && ok; start += batch) {
+		const size_t count = std::min(batch, regions.size() - start);
+		std::vector<Patch> patches(count);
+
+		tbb::parallel_for(size_t(0), count, [&](size_t n) {
+			Mesh(regions[start + n], patches[n]);
+		});
+
+		// file indices depend on every region before, so they are handed out in order
+		if (format != STL) {
+			DendroTrace::Span phase("index vertices");
+			for (size_t n = 0; n < count; n++) {
+				Index(regions[start + n], patches[n]);
+			}
+		}
+
+		tbb::parallel_for(size_t(0), count, [&](size_t n) {
+			Encode(patches[n], format);
+		});
+
+		DendroTrace::Span phase("write batch");
+
+		for (size_t n = 0; n < count && ok; n++) {
+			ok = Put(file, patches[n].vertexBytes) && Put(spool ? spool : file, patches[n].faceBytes);
+			faceCount += patches[n].records;
+		}
+	}
+
+	if (ok && format == STL) {
+		ok = faceCount <= std::numeric_limits<uint32_t>::max();
+
+		const uint32_t triangles = static_cast<uint32_t>(faceCount);
+		ok = ok && std::fseek(file, STL_HEADER, SEEK_SET) == 0 && std::fwrite(&triangles, sizeof(triangles), 1, file) == 1;
+	}
+	else if (ok && format == PLY) {
+		DendroTrace::Span phase("append faces");
+
+		// ply indices are 32 bit
+		ok = mVertexCount <= std::numeric_limits<uint32_t>::max() && std::fseek(spool, 0, SEEK_SET) == 0;
+
+		std::vector<char> buffer(size_t(1) << 20);
+		size_t read = 0;
+		while (ok && (read = std::fread(buffer.data(), 1, buffer.size(), spool)) > 0) {
+			ok = std::fwrite(buffer.data(), 1, read, file) == read;
+		}
+		ok = ok && !std::ferror(spool);
+
+		const std::string header = PlyHeader(mVertexCount, faceCount);
+		ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(header.data(), 1, header.size(), file) == header.size();
+	}
+
+	if (spool) {
+		std::fclose(spool);
+		std::remove(spoolPath.c_str());
+	}
+
+	ok = (std::fclose(file) == 0) && ok;
+	if (!ok) {
+		std::remove(path);
+	}
+
+	mSeams.clear();
+
+	return ok;
+}
+
+std::vector<openvdb::Coord> DendroExport::Regions() const
+{
+	DendroTrace::Span span("DendroExport::Regions");
+
+	// every region within a voxel of a leaf, a crossing on a leaf face can put a polygon center
+	// just past it
+	std::set<openvdb::Coord> regions;
+	for (auto it = mGrid.tree().cbeginLeaf(); it; ++it) {
+		openvdb::CoordBBox bbox = it->getNodeBoundingBox();
+		bbox.expand(1);
+
+		for (int x = bbox.min().x() >> REGION_LOG2; x <= bbox.max().x() >> REGION_LOG2; x++) {
+			for (int y = bbox.min().y() >> REGION_LOG2; y <= bbox.max().y() >> REGION_LOG2; y++) {
+				for (int z = bbox.min().z() >> REGION_LOG2; z <= bbox.max().z() >> REGION_LOG2; z++) {
+					regions.insert(openvdb::Coord(x, y, z));
+				}
+			}
+		}
+	}
+
+	return std::vector<openvdb::Coord>(regions.begin(), regions.end());
+}
+
+void DendroExport::Mesh(const openvdb::Coord& region, Patch& patch) const
+{
+	DendroTrace::Span span("DendroExport::Mesh");
+
+	using SamplerT = openvdb::tools::GridSampler<openvdb::FloatGrid::ConstAccessor, openvdb::tools::BoxSampler>;
+
+	const openvdb::Coord lo(region.x() * REGION, region.y() * REGION, region.z() * REGION);
+	const openvdb::CoordBBox owned(lo, lo.offsetBy(REGION - 1));
+
+	openvdb::CoordBBox copied = owned;
+	copied.expand(MARGIN);
+
+	openvdb::CoordBBox inner = owned;
+	inner.expand(-SEAM);
+
+	// leaves are copied as they are and tiles at leaf size, so the inside keeps its sign right up
+	// to the margin and everything past it reads as background
+	openvdb::FloatGrid::Ptr part = mGrid.copyWithNewTree();
+	{
+		DendroTrace::Span phase("copy region");
+
+		auto acc = mGrid.getConstAccessor();
+		const float background = mGrid.background();
+
+		for (int x = copied.min().x(); x <= copied.max().x(); x += LeafT::DIM) {
+			for (int y = copied.min().y(); y <= copied.max().y(); y += LeafT::DIM) {
+				for (int z = copied.min().z(); z <= copied.max().z(); z += LeafT::DIM) {
+					const openvdb::Coord origin(x, y, z);
+
+					if (const LeafT *leaf = acc.probeConstLeaf(origin)) {
+						part->tree().addLeaf(new LeafT(*leaf));
+						continue;
+					}
+
+					const float value = acc.getValue(origin);
+					const bool active = acc.isValueOn(origin);
+					if (active || value != background) {
+						part->tree().addTile(1, origin, value, active);
+					}
+				}
+			}
+		}
+	}
+
+	openvdb::tools::VolumeToMesh mesher(mIsovalue, mAdaptivity);
+
+	// voxels in the adaptivity mask are never merged, here everything outside the inner box
+	if (mAdaptivity > 0.0) {
+		openvdb::BoolTree::Ptr mask(new openvdb::BoolTree(false));
+		mask->fill(copied, true, true);
+		mask->fill(inner, false, false);
+		mesher.setAdaptivityMask(mask);
+	}
+
+	{
+		DendroTrace::Span phase("VolumeToMesh");
+		mesher(*part);
+	}
+
+	DendroTrace::Span phase("keep polygons");
+
+	const size_t pointCount = mesher.pointListSize();
+	const openvdb::tools::PointList& points = mesher.pointList();
+	openvdb::tools::PolygonPoolList& pools = mesher.polygonPoolList();
+
+	// ownership is decided in index space, where region borders fall on whole voxels
+	std::vector<openvdb::Vec3d> indexPoints(pointCount);
+	for (size_t i = 0; i < pointCount; i++) {
+		indexPoints[i] = part->worldToIndex(openvdb::Vec3d(points[i]));
+	}
+
+	std::vector<openvdb::Index32> remap(pointCount, openvdb::util::INVALID_IDX);
+
+	// polygons are wound to face along the gradient, the same convention as DendroMesh::Orient
+	auto acc = part->getConstAccessor();
+	SamplerT sampler(acc, part->transform());
+
+	const openvdb::Vec3d voxelSize = part->voxelSize();
+	const double h = 0.5 * std::min(voxelSize.x(), std::min(voxelSize.y(), voxelSize.z()));
+	const double sign = (part->getGridClass() == openvdb::GRID_LEVEL_SET) ? 1.0 : -1.0;
+
+	auto keep = [&](openvdb::Vec4I f) {
+		if (!Collapse(f)) {
+			return;
+		}
+
+		// kept by the region holding the center of its bounds, which every region computes the same
+		const int corners = Corners(f);
+
+		openvdb::Vec3d min = indexPoints[f[0]], max = min;
+		for (int i = 1; i < corners; i++) {
+			for (int a = 0; a < 3; a++) {
+				min[a] = std::min(min[a], indexPoints[f[i]][a]);
+				max[a] = std::max(max[a], indexPoints[f[i]][a]);
+			}
+		}
+
+		if (!owned.isInside(openvdb::Coord::floor(0.5 * (min + max)))) {
+			return;
+		}
+
+		openvdb::Vec3d normal(0.0), center(0.0);
+		for (int i = 0; i < corners; i++) {
+			const openvdb::Vec3d a(points[f[i]]);
+			const openvdb::Vec3d b(points[f[(i + 1) % corners]]);
+			normal += a.cross(b);
+			center += a;
+		}
+
+		if (normal.lengthSqr() <= 0.0) {
+			return;
+		}
+
+		center /= double(corners);
+
+		const openvdb::Vec3d gradient(
+			sampler.wsSample(center + openvdb::Vec3d(h, 0, 0)) - sampler.wsSample(center - openvdb::Vec3d(h, 0, 0)),
+			sampler.wsSample(center + openvdb::Vec3d(0, h, 0)) - sampler.wsSample(center - openvdb::Vec3d(0, h, 0)),
+			sampler.wsSample(center + openvdb::Vec3d(0, 0, h)) - sampler.wsSample(center - openvdb::Vec3d(0, 0, h)));
+
+		if (normal.dot(gradient) * sign < 0.0) {
+			if (corners == 3) {
+				std::swap(f[1], f[2]);
+			}
+			else {
+				std::swap(f[1], f[3]);
+			}
+		}
+
+		for (int i = 0; i < corners; i++) {
+			if (remap[f[i]] == openvdb::util::INVALID_IDX) {
+				remap[f[i]] = static_cast<openvdb::Index32>(patch.points.size());
+				patch.points.push_back(points[f[i]]);
+				patch.seam.push_back(inner.isInside(openvdb::Coord::floor(indexPoints[f[i]])) ? 0 : 1);
+			}
+			f[i] = remap[f[i]];
+		}
+
+		patch.faces.push_back(f);
+	};
+
+	for (size_t n = 0; n < mesher.polygonPoolListSize(); n++) {
+		const openvdb::tools::PolygonPool& pool = pools[n];
+
+		for (size_t q = 0; q < pool.numQuads(); q++) {
+			keep(pool.quad(q));
+		}
+
+		for (size_t t = 0; t < pool.numTriangles(); t++) {
+			const openvdb::Vec3I& triangle = pool.triangle(t);
+			keep(openvdb::Vec4I(triangle[0], triangle[1], triangle[2], openvdb::util::INVALID_IDX));
+		}
+	}
+}
+
+void DendroExport::Index(const openvdb::Coord& region, Patch& patch)
+{
+	// regions come in x order, nothing a slab behind the previous one can touch this one or later
+	while (!mSeams.empty() && mSeams.begin()->first.x() < region.x() - 1) {
+		mSeams.erase(mSeams.begin());
+	}
+
+	std::vector<const SeamMap*> neighbours;
+	for (int x = -1; x <= 1; x++) {
+		for (int y = -1; y <= 1; y++) {
+			for (int z = -1; z <= 1; z++) {
+				auto it = mSeams.find(region.offsetBy(x, y, z));
+				if (it != mSeams.end() && (x != 0 || y != 0 || z != 0)) {
+					neighbours.push_back(&it->second);
+				}
+			}
+		}
+	}
+
+	SeamMap& own = mSeams[region];
+
+	// seam vertices already written by a neighbour are shared, every other vertex is new
+	patch.index.resize(patch.points.size());
+	for (size_t i = 0; i < patch.points.size(); i++) {
+		if (patch.seam[i]) {
+			const float xyz[3] = { patch.points[i].x(), patch.points[i].y(), patch.points[i].z() };
+
+			SeamKey key;
+			std::memcpy(key.bits, xyz, sizeof(key.bits));
+
+			bool shared = false;
+			for (auto it = neighbours.begin(); it != neighbours.end() && !shared; ++it) {
+				auto found = (*it)->find(key);
+				if (found != (*it)->end()) {
+					patch.index[i] = found->second;
+					shared = true;
+				}
+			}
+
+			if (shared) {
+				continue;
+			}
+
+			own.emplace(key, mVertexCount);
+		}
+
+		patch.index[i] = mVertexCount++;
+		patch.fresh.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+void DendroExport::Encode(Patch& patch, int format) const
+{
+	DendroTrace::Span span("DendroExport::Encode");
+
+	patch.records = 0;
+
+	if (format == STL) {
+		// quads are split along their first diagonal, each triangle is 50 bytes
+		for (auto it = patch.faces.begin(); it != patch.faces.end(); ++it) {
+			const int corners = Corners(*it);
+			for (int t = 1; t + 1 < corners; t++) {
+				const openvdb::Vec3s& a = patch.points[(*it)[0]];
+				const openvdb::Vec3s& b = patch.points[(*it)[t]];
+				const openvdb::Vec3s& c = patch.points[(*it)[t + 1]];
+
+				openvdb::Vec3s normal = (b - a).cross(c - a);
+				const float length = normal.length();
+				normal = (length > 0.0f) ? normal / length : openvdb::Vec3s(0.0f);
+
+				const float record[12] = {
+					normal.x(), normal.y(), normal.z(),
+					a.x(), a.y(), a.z(),
+					b.x(), b.y(), b.z(),
+					c.x(), c.y(), c.z() };
+				const uint16_t attributes = 0;
+
+				Append(patch.faceBytes, record);
+				Append(patch.faceBytes, attributes);
+				patch.records++;
+			}
+		}
+	}
+	else if (format == PLY) {
+		patch.records = patch.faces.size();
+
+		patch.vertexBytes.reserve(patch.fresh.size() * 3 * sizeof(float));
+		for (auto it = patch.fresh.begin(); it != patch.fresh.end(); ++it) {
+			const openvdb::Vec3s& p = patch.points[*it];
+			const float xyz[3] = { p.x(), p.y(), p.z() };
+			Append(patch.vertexBytes, xyz);
+		}
+
+		for (auto it = patch.faces.begin(); it != patch.faces.end(); ++it) {
+			const uint8_t corners = static_cast<uint8_t>(Corners(*it));
+			Append(patch.faceBytes, corners);
+			for (int i = 0; i < corners; i++) {
+				Append(patch.faceBytes, static_cast<uint32_t>(patch.index[(*it)[i]]));
+			}
+		}
+	}
+	else {
+		// obj vertices of a patch are written ahead of its faces, so every face refers back
+		char line[128];
+
+		patch.records = patch.faces.size();
+
+		for (auto it = patch.fresh.begin(); it != patch.fresh.end(); ++it) {
+			const openvdb::Vec3s& p = patch.points[*it];
+			Append(patch.vertexBytes, line, std::snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", p.x(), p.y(), p.z()));
+		}
+
+		for (auto it = patch.faces.begin(); it != patch.faces.end(); ++it) {
+			const openvdb::Vec4I& f = *it;
+			if (Corners(f) == 3) {
+				Append(patch.faceBytes, line, std::snprintf(line, sizeof(line), "f %llu %llu %llu\n",
+					static_cast<unsigned long long>(patch.index[f[0]] + 1),
+					static_cast<unsigned long long>(patch.index[f[1]] + 1),
+					static_cast<unsigned long long>(patch.index[f[2]] + 1)));
+			}
+			else {
+				Append(patch.faceBytes, line, std::snprintf(line, sizeof(line), "f %llu %llu %llu %llu\n",
+					static_cast<unsigned long long>(patch.index[f[0]] + 1),
+					static_cast<unsigned long long>(patch.index[f[1]] + 1),
+					static_cast<unsigned long long>(patch.index[f[2]] + 1),
+					static_cast<unsigned long long>(patch.index[f[3]] + 1)));
+			}
+		}
+	}
+
+	// the polygons are no longer needed once encoded
+	std::vector<openvdb::Vec3s>().swap(patch.points);
+	std::vector<openvdb::Vec4I>().swap(patch.faces);
+}
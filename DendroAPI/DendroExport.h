@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef __DENDROEXPORT_H__
+#define __DENDROEXPORT_H__
+
+#define IMATH_HALF_NO_LOOKUP_TABLE
+
+#include <openvdb/openvdb.h>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// streams a grid straight to a mesh file. the active bounds are cut into fixed size regions that are
+// meshed a batch at a time, each region on its own copy of just the voxels around it, so memory is
+// bounded by the batch no matter how large the output is. a polygon is kept by the region holding
+// its center and voxels near region borders are never merged, so neighbouring regions agree on the
+// seam polygons and vertices and the file stays watertight
+class DendroExport
+{
+public:
+	enum Format {
+		STL = 0,
+		PLY = 1,
+		OBJ = 2
+	};
+
+	DendroExport(const openvdb::FloatGrid& grid, double isovalue, double adaptivity);
+
+	// binary stl, binary little endian ply or ascii obj. stl holds triangles only, ply and obj keep
+	// quads and share vertices across region seams. returns false if the file could not be written
+	bool Write(const char * path, int format);
+
+private:
+	struct Patch {
+		std::vector<openvdb::Vec3s> points;
+		std::vector<uint8_t> seam;
+		std::vector<openvdb::Vec4I> faces;
+
+		// file indices of the points and the points first written by this patch
+		std::vector<uint64_t> index;
+		std::vector<uint32_t> fresh;
+
+		std::vector<char> vertexBytes;
+		std::vector<char> faceBytes;
+
+		// stl triangles or ply and obj faces in faceBytes
+		uint64_t records;
+	};
+
+	struct SeamKey {
+		uint32_t bits[3];
+		bool operator==(const SeamKey& other) const;
+	};
+
+	struct SeamHash {
+		size_t operator()(const SeamKey& key) const;
+	};
+
+	using SeamMap = std::unordered_map<SeamKey, uint64_t, SeamHash>;
+
+	std::vector<openvdb::Coord> Regions() const;
+	void Mesh(const openvdb::Coord& region, Patch& patch) const;
+	void Index(const openvdb::Coord& region, Patch& patch);
+	void Encode(Patch& patch, int format) const;
+
+	const openvdb::FloatGrid& mGrid;
+	double mIsovalue;
+	double mAdaptivity;
+
+	// seam vertices of recently written regions, dropped once no later region can touch them
+	std::map<openvdb::Coord, SeamMap> mSeams;
+	uint64_t mVertexCount;
+};
+
+#endif // __DENDROEXPORT_H__
@@ -0,0 +1,422 @@
+#include "stdafx.h"
+#include "DendroFilter.h"
+#include "DendroTrace.h"
+
+#include <openvdb/tools/ChangeBackground.h>
+#include <openvdb/tools/FastSweeping.h>
+#include <openvdb/tools/Interpolation.h>
+#include <openvdb/tools/Prune.h>
+#include <openvdb/tree/LeafManager.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DENDRO_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define DENDRO_TARGET(isa)
+#else
+#define DENDRO_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace {
+
+	// out[k] = keep[k] ? in[k] : scale * sum of in[k + i * stride] for i in [-width, width]. every
+	// kernel adds in the same order so they agree bit for bit
+	typedef void (*SumFn)(const float * in, const uint32_t * keep, float * out, int count, ptrdiff_t stride, int width, float scale);
+
+	void SumScalar(const float * in, const uint32_t * keep, float * out, int count, ptrdiff_t stride, int width, float scale)
+	{
+		for (int k = 0; k < count; k++) {
+			if (keep[k]) {
+				out[k] = in[k];
+				continue;
+			}
+
+			float sum = 0.0f;
+			for (int i = -width; i <= width; i++) {
+				sum += in[k + i * stride];
+			}
+			out[k] = sum * scale;
+		}
+	}
+
+#ifdef DENDRO_X86
+	DENDRO_TARGET("avx2")
+	void SumAvx2(const float * in, const uint32_t * keep, float * out, int count, ptrdiff_t stride, int width, float scale)
+	{
+		const __m256 s = _mm256_set1_ps(scale);
+
+		int k = 0;
+		for (; k + 8 <= count; k += 8) {
+			__m256 sum = _mm256_setzero_ps();
+			for (int i = -width; i <= width; i++) {
+				sum = _mm256_add_ps(sum, _mm256_loadu_ps(in + k + i * stride));
+			}
+
+			const __m256 mask = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keep + k)));
+			_mm256_storeu_ps(out + k, _mm256_blendv_ps(_mm256_mul_ps(sum, s), _mm256_loadu_ps(in + k), mask));
+		}
+
+		SumScalar(in + k, keep + k, out + k, count - k, stride, width, scale);
+	}
+
+	DENDRO_TARGET("avx512f")
+	void SumAvx512(const float * in, const uint32_t * keep, float * out, int count, ptrdiff_t stride, int width, float scale)
+	{
+		const __m512 s = _mm512_set1_ps(scale);
+
+		int k = 0;
+		for (; k + 16 <= count; k += 16) {
+			__m512 sum = _mm512_setzero_ps();
+			for (int i = -width; i <= width; i++) {
+				sum = _mm512_add_ps(sum, _mm512_loadu_ps(in + k + i * stride));
+			}
+
+			const __mmask16 mask = _mm512_test_epi32_mask(
+				_mm512_loadu_si512(keep + k), _mm512_set1_epi32(-1));
+			_mm512_storeu_ps(out + k, _mm512_mask_blend_ps(mask, _mm512_mul_ps(sum, s), _mm512_loadu_ps(in + k)));
+		}
+
+		// short rows, such as the eight voxel z pass, finish on the avx2 path
+		SumAvx2(in + k, keep + k, out + k, count - k, stride, width, scale);
+	}
+#endif
+
+	int DetectInstructions()
+	{
+#ifdef DENDRO_X86
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return DendroFilter::SCALAR;
+		}
+
+		// the os has to save the wider registers as well as the cpu having them
+		__cpuidex(info, 1, 0);
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) {
+			return DendroFilter::SCALAR;
+		}
+		const unsigned long long xcr0 = _xgetbv(0);
+
+		__cpuidex(info, 7, 0);
+		if ((info[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6) {
+			return DendroFilter::AVX512;
+		}
+		if ((info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6) {
+			return DendroFilter::AVX2;
+		}
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) {
+			return DendroFilter::AVX512;
+		}
+		if (__builtin_cpu_supports("avx2")) {
+			return DendroFilter::AVX2;
+		}
+#endif
+#endif
+		return DendroFilter::SCALAR;
+	}
+
+	const int gSupported = DetectInstructions();
+	std::atomic<int> gInstructions(gSupported);
+	std::atomic<int> gEngine(DendroFilter::OPENVDB);
+	std::atomic<double> gSweepThreshold(4.0);
+
+	SumFn SelectKernel()
+	{
+#ifdef DENDRO_X86
+		switch (gInstructions.load()) {
+		case DendroFilter::AVX512:
+			return SumAvx512;
+		case DendroFilter::AVX2:
+			return SumAvx2;
+		default:
+			break;
+		}
+#endif
+		return SumScalar;
+	}
+
+	// one box pass in x, y and z over a block of side 8 + 2 * width stored with z fastest, the same
+	// order as a leaf. halo voxels are filtered as well where a later pass reads them, so the three
+	// passes over a block give what three global passes would. the result is left in a
+	void FilterBlock(std::vector<float>& a, std::vector<float>& b, const std::vector<uint32_t>& keep, int width, SumFn sum)
+	{
+		const int dim = openvdb::FloatTree::LeafNodeType::DIM;
+		const ptrdiff_t side = dim + 2 * width;
+		const ptrdiff_t slab = side * side;
+		const float scale = 1.0f / float(2 * width + 1);
+
+		// x for the interior slabs, every y and z
+		const ptrdiff_t xStart = width * slab;
+		sum(&a[xStart], &keep[xStart], &b[xStart], static_cast<int>(dim * slab), slab, width, scale);
+
+		// y for interior x and y, every z
+		for (ptrdiff_t x = width; x < width + dim; x++) {
+			const ptrdiff_t start = (x * side + width) * side;
+			sum(&b[start], &keep[start], &a[start], static_cast<int>(dim * side), side, width, scale);
+		}
+
+		// z for the interior only, this pass runs along the contiguous rows
+		for (ptrdiff_t x = width; x < width + dim; x++) {
+			for (ptrdiff_t y = width; y < width + dim; y++) {
+				const ptrdiff_t start = (x * side + y) * side + width;
+				sum(&a[start], &keep[start], &b[start], dim, 1, width, scale);
+			}
+		}
+
+		a.swap(b);
+	}
+
+}
+
+DendroFilter::DendroFilter(openvdb::FloatGrid& grid) : mGrid(grid), mTracker(grid)
+{
+	// same tracker settings LevelSetFilter runs with
+	mTracker.setGrainSize(1);
+}
+
+void DendroFilter::Mean(int width)
+{
+	DendroTrace::Span span("DendroFilter::Mean");
+
+	Box(width);
+}
+
+void DendroFilter::Gaussian(int width)
+{
+	DendroTrace::Span span("DendroFilter::Gaussian");
+
+	// four box passes approximate the gaussian, as in LevelSetFilter
+	for (int n = 0; n < 4; n++) {
+		Box(width);
+	}
+}
+
+void DendroFilter::Box(int width)
+{
+	using LeafT = openvdb::FloatTree::LeafNodeType;
+
+	width = std::max(1, width);
+
+	const int dim = LeafT::DIM;
+	const int side = dim + 2 * width;
+	const size_t volume = size_t(side) * side * side;
+
+	const SumFn sum = SelectKernel();
+
+	openvdb::tree::LeafManager<openvdb::FloatTree> leafs(mGrid.tree(), 1);
+
+	{
+		DendroTrace::Span span("dense box pass");
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leafs.leafCount(), 1), [&](const tbb::blocked_range<size_t>& r) {
+			auto acc = mGrid.getConstAccessor();
+
+			std::vector<float> a(volume), b(volume);
+			std::vector<uint32_t> keep(volume);
+
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				const LeafT& leaf = leafs.leaf(n);
+				const openvdb::Coord lo = leaf.origin().offsetBy(-width);
+				const openvdb::Coord hi = leaf.origin().offsetBy(dim - 1 + width);
+
+				// gather from every leaf the halo touches. regions without a leaf are tiles, which
+				// the filter leaves unchanged just as it does inactive voxels
+				for (int bx = lo.x() & ~(dim - 1); bx <= hi.x(); bx += dim) {
+					for (int by = lo.y() & ~(dim - 1); by <= hi.y(); by += dim) {
+						for (int bz = lo.z() & ~(dim - 1); bz <= hi.z(); bz += dim) {
+							const openvdb::Coord origin(bx, by, bz);
+							const LeafT *source = acc.probeConstLeaf(origin);
+							const float tile = source ? 0.0f : acc.getValue(origin);
+
+							const int x0 = std::max(bx, lo.x()), x1 = std::min(bx + dim - 1, hi.x());
+							const int y0 = std::max(by, lo.y()), y1 = std::min(by + dim - 1, hi.y());
+							const int z0 = std::max(bz, lo.z()), z1 = std::min(bz + dim - 1, hi.z());
+
+							for (int x = x0; x <= x1; x++) {
+								for (int y = y0; y <= y1; y++) {
+									size_t i = (size_t(x - lo.x()) * side + size_t(y - lo.y())) * side + size_t(z0 - lo.z());
+									for (int z = z0; z <= z1; z++, i++) {
+										if (source) {
+											const openvdb::Index offset = LeafT::coordToOffset(openvdb::Coord(x, y, z));
+											a[i] = source->getValue(offset);
+											keep[i] = source->isValueOn(offset) ? 0u : ~0u;
+										}
+										else {
+											a[i] = tile;
+											keep[i] = ~0u;
+										}
+									}
+								}
+							}
+						}
+					}
+				}
+
+				FilterBlock(a, b, keep, width, sum);
+
+				// scatter the interior into the auxiliary buffer, other leaves still read the originals
+				auto& buffer = leafs.getBuffer(n, 1);
+				for (int x = 0; x < dim; x++) {
+					for (int y = 0; y < dim; y++) {
+						const size_t row = (size_t(x + width) * side + size_t(y + width)) * side + width;
+						for (int z = 0; z < dim; z++) {
+							buffer.setValue(LeafT::coordToOffset(leaf.origin().offsetBy(x, y, z)), a[row + z]);
+						}
+					}
+				}
+			}
+		});
+
+		leafs.swapLeafBuffer(1);
+	}
+
+	{
+		DendroTrace::Span span("LevelSetTracker::track");
+		mTracker.track();
+	}
+}
+
+void DendroFilter::SetEngine(int engine)
+{
+	gEngine.store(engine == DENSE ? DENSE : OPENVDB);
+}
+
+int DendroFilter::ActiveEngine()
+{
+	return gEngine.load();
+}
+
+void DendroFilter::SetInstructions(int instructions)
+{
+	gInstructions.store(std::max(int(SCALAR), std::min(instructions, gSupported)));
+}
+
+int DendroFilter::ActiveInstructions()
+{
+	return gInstructions.load();
+}
+
+int DendroFilter::SupportedInstructions()
+{
+	return gSupported;
+}
+
+void DendroFilter::SetSweepThreshold(double voxels)
+{
+	gSweepThreshold.store(voxels);
+}
+
+double DendroFilter::SweepThreshold()
+{
+	return gSweepThreshold.load();
+}
+
+openvdb::FloatGrid::Ptr DendroFilter::Sweep(const openvdb::FloatGrid& grid, double amount, const openvdb::FloatGrid * mask, double min, double max, bool invert)
+{
+	using LeafT = openvdb::FloatTree::LeafNodeType;
+
+	DendroTrace::Span span("DendroFilter::Sweep");
+
+	if (grid.tree().activeVoxelCount() == 0) {
+		return openvdb::FloatGrid::Ptr();
+	}
+
+	const float background = grid.background();
+	const double voxelSize = grid.voxelSize()[0];
+
+	// onion rings out to the new surface, the existing band already covers its own width past it
+	openvdb::FloatGrid::Ptr sdf;
+	{
+		DendroTrace::Span phase("dilateSdf");
+		const int dilation = static_cast<int>(std::ceil(std::abs(amount) / voxelSize)) + 1;
+		sdf = openvdb::tools::dilateSdf(grid, dilation, openvdb::tools::NN_FACE_EDGE);
+	}
+
+	if (!sdf) {
+		return sdf;
+	}
+
+	if (sdf->background() != background) {
+		openvdb::tools::changeLevelSetBackground(sdf->tree(), background);
+	}
+
+	{
+		DendroTrace::Span phase("shift distances");
+
+		openvdb::tree::LeafManager<openvdb::FloatTree> leafs(sdf->tree());
+
+		// same weights as the LevelSetFilter alpha mask, a smooth step of the mask over [min, max].
+		// without a mask the grid itself stands in for it and is never sampled
+		const openvdb::FloatGrid& weights = mask ? *mask : grid;
+		const double inverseRange = (max > min) ? 1.0 / (max - min) : 0.0;
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leafs.leafCount()), [&](const tbb::blocked_range<size_t>& r) {
+			// the sampler holds on to the accessor, so both live for the whole task
+			auto acc = weights.getConstAccessor();
+			openvdb::tools::GridSampler<openvdb::FloatGrid::ConstAccessor, openvdb::tools::BoxSampler> sampler(acc, weights.transform());
+
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				LeafT& leaf = leafs.leaf(n);
+				for (auto it = leaf.beginValueOn(); it; ++it) {
+					double weight = 1.0;
+					if (mask) {
+						const double value = sampler.wsSample(sdf->indexToWorld(it.getCoord()));
+						weight = (max > min) ? openvdb::math::SmoothUnitStep((value - min) * inverseRange) : ((value >= max) ? 1.0 : 0.0);
+						if (invert) {
+							weight = 1.0 - weight;
+						}
+					}
+
+					it.setValue(static_cast<float>(*it - amount * weight));
+				}
+			}
+		});
+	}
+
+	// a uniform shift of exact distances is exact, a weighted one has to be solved again
+	if (mask) {
+		DendroTrace::Span phase("sdfToSdf");
+		sdf = openvdb::tools::sdfToSdf(*sdf, 0.0f);
+		if (!sdf) {
+			return sdf;
+		}
+	}
+
+	{
+		DendroTrace::Span phase("trim band");
+
+		openvdb::tree::LeafManager<openvdb::FloatTree> leafs(sdf->tree());
+
+		// back to the original width, voxels past it become background on their side
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leafs.leafCount()), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				LeafT& leaf = leafs.leaf(n);
+				for (openvdb::Index offset = 0; offset < LeafT::SIZE; offset++) {
+					const float value = leaf.getValue(offset);
+					if (leaf.isValueOn(offset) && std::abs(value) >= background) {
+						leaf.setValueOff(offset, (value > 0.0f) ? background : -background);
+					}
+				}
+			}
+		});
+
+		openvdb::tools::pruneLevelSet(sdf->tree());
+	}
+
+	return sdf;
+}
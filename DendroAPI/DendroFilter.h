@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef __DENDROFILTER_H__
+#define __DENDROFILTER_H__
+
+#define IMATH_HALF_NO_LOOKUP_TABLE
+
+#include <openvdb/openvdb.h>
+#include <openvdb/tools/LevelSetTracker.h>
+
+// dense block level set filter. every leaf is gathered with its halo into a dense block, the box
+// passes run over contiguous rows with simd kernels, and the result is scattered back. matches
+// LevelSetFilter mean and gaussian up to float summation order. large offsets are done by fast
+// sweeping rather than by tracking the front
+class DendroFilter
+{
+public:
+	enum Engine {
+		OPENVDB = 0,
+		DENSE
+	};
+
+	enum Instructions {
+		SCALAR = 0,
+		AVX2,
+		AVX512
+	};
+
+	explicit DendroFilter(openvdb::FloatGrid& grid);
+
+	void Mean(int width);
+	void Gaussian(int width);
+
+	// engine used by DendroGrid::Smooth for unmasked mean and gaussian filtering
+	static void SetEngine(int engine);
+	static int ActiveEngine();
+
+	// kernels default to the widest the cpu supports, a request past that is clamped
+	static void SetInstructions(int instructions);
+	static int ActiveInstructions();
+	static int SupportedInstructions();
+
+	// offsets of more than this many voxels are swept by DendroGrid::Offset, a negative threshold
+	// leaves every offset to LevelSetFilter
+	static void SetSweepThreshold(double voxels);
+	static double SweepThreshold();
+
+	// copy of grid offset outwards by amount. the band is dilated to reach the new surface and the
+	// distances in it are solved by fast sweeping, so the cost barely depends on the distance. a mask
+	// weights the amount per voxel the way LevelSetFilter does. null when the grid has no band
+	static openvdb::FloatGrid::Ptr Sweep(const openvdb::FloatGrid& grid, double amount, const openvdb::FloatGrid * mask = nullptr, double min = 0.0, double max = 1.0, bool invert = false);
+
+private:
+	void Box(int width);
+
+	openvdb::FloatGrid& mGrid;
+	openvdb::tools::LevelSetTracker<openvdb::FloatGrid> mTracker;
+};
+
+#endif // __DENDROFILTER_H__
@@ -0,0 +1,95 @@
+// DendroFilterBench.cpp : compares the openvdb and dense block smoothing engines
+//
+// usage: dendro-filter-bench [voxelSize] [iterations] [width]
+//
+// smooths the same torus with both engines, and with every kernel the cpu supports, then reports
+// the time taken and how far each result is from the openvdb one in voxel units
+
+#include "DendroGrid.h"
+#include "DendroFilter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+	struct Difference {
+		double max;
+		double mean;
+	};
+
+	Difference Compare(const openvdb::FloatGrid& reference, const openvdb::FloatGrid& grid)
+	{
+		auto acc = grid.getConstAccessor();
+		const double voxelSize = reference.voxelSize()[0];
+
+		Difference diff = { 0.0, 0.0 };
+		size_t count = 0;
+
+		for (auto it = reference.cbeginValueOn(); it; ++it) {
+			const double d = std::abs(double(*it) - double(acc.getValue(it.getCoord()))) / voxelSize;
+			diff.max = std::max(diff.max, d);
+			diff.mean += d;
+			count++;
+		}
+
+		diff.mean = (count > 0) ? diff.mean / count : 0.0;
+		return diff;
+	}
+
+	double Run(DendroGrid& grid, int type, int iterations, int width)
+	{
+		auto start = std::chrono::steady_clock::now();
+		grid.Smooth(type, iterations, width);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+}
+
+int main(int argc, char * argv[])
+{
+	const double voxelSize = (argc > 1) ? std::atof(argv[1]) : 0.05;
+	const int iterations = (argc > 2) ? std::atoi(argv[2]) : 20;
+	const int width = (argc > 3) ? std::atoi(argv[3]) : 1;
+
+	// results would otherwise come back from the cache after the first run
+	DendroCache::Instance().SetCapacity(0);
+
+	DendroGrid source;
+	source.CreateTorus(openvdb::math::Mat4d::identity(), 4.0, 1.5, voxelSize, 3.0);
+
+	std::printf("torus, voxel size %g, %llu active voxels, %d iterations of width %d\n\n",
+		voxelSize, static_cast<unsigned long long>(source.Grid()->activeVoxelCount()), iterations, width);
+	std::printf("%-10s %-10s %12s %10s %12s %12s\n", "filter", "engine", "time (s)", "speedup", "max diff", "mean diff");
+
+	const char * names[] = { "scalar", "avx2", "avx-512" };
+	const int types[] = { 2, 0 };
+
+	for (int t = 0; t < 2; t++) {
+		const int type = types[t];
+		const char * filter = (type == 0) ? "gaussian" : "mean";
+
+		DendroFilter::SetEngine(DendroFilter::OPENVDB);
+		DendroGrid reference(&source);
+		const double baseline = Run(reference, type, iterations, width);
+
+		std::printf("%-10s %-10s %12.3f %10s %12s %12s\n", filter, "openvdb", baseline, "1.00x", "-", "-");
+
+		DendroFilter::SetEngine(DendroFilter::DENSE);
+		for (int isa = DendroFilter::SCALAR; isa <= DendroFilter::SupportedInstructions(); isa++) {
+			DendroFilter::SetInstructions(isa);
+
+			DendroGrid grid(&source);
+			const double seconds = Run(grid, type, iterations, width);
+			const Difference diff = Compare(*reference.Grid(), *grid.Grid());
+
+			std::printf("%-10s %-10s %12.3f %9.2fx %12.2e %12.2e\n", filter, names[isa], seconds, baseline / seconds, diff.max, diff.mean);
+		}
+	}
+
+	return 0;
+}
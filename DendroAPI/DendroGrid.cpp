@@ -1,5 +1,11 @@
 #include "stdafx.h"
 #include "DendroGrid.h"
+#include "DendroTrace.h"
+#include "DendroFilter.h"
+#include "DendroDense.h"
+#include "DendroExport.h"
+#include "DendroRaster.h"
+#include "DendroSlice.h"
 
 #include <openvdb/tools/VolumeToMesh.h>
 #include <openvdb/tools/MeshToVolume.h>
@@ -10,32 +16,362 @@
 #include <openvdb/tools/ParticlesToLevelSet.h>
 #include <openvdb/Types.h>
 #include <openvdb/tools/VolumeToSpheres.h>
+#include <openvdb/tools/LevelSetTracker.h>
+#include <openvdb/tools/Prune.h>
+#include <openvdb/tools/SignedFloodFill.h>
+#include <openvdb/util/Util.h>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <mutex>
+
+namespace {
+
+	// openvdb only needs registering once per process, not once per grid
+	void InitializeOnce()
+	{
+		static std::once_flag initialized;
+		std::call_once(initialized, []() { openvdb::initialize(); });
+	}
+
+	// world space bounds of a grid's active voxels, false when nothing is active
+	bool ActiveWorldBounds(const openvdb::FloatGrid& grid, openvdb::Vec3d& bMin, openvdb::Vec3d& bMax)
+	{
+		openvdb::CoordBBox bbox;
+		if (!grid.tree().evalActiveVoxelBoundingBox(bbox)) {
+			return false;
+		}
+
+		bMin = openvdb::Vec3d(std::numeric_limits<double>::max());
+		bMax = openvdb::Vec3d(-std::numeric_limits<double>::max());
+
+		// transform all eight corners so rotated grids are bounded too
+		for (int i = 0; i < 8; i++) {
+			openvdb::Vec3d corner(
+				(i & 1) ? bbox.max().x() + 0.5 : bbox.min().x() - 0.5,
+				(i & 2) ? bbox.max().y() + 0.5 : bbox.min().y() - 0.5,
+				(i & 4) ? bbox.max().z() + 0.5 : bbox.min().z() - 0.5);
+			openvdb::Vec3d world = grid.indexToWorld(corner);
+			for (int a = 0; a < 3; a++) {
+				bMin[a] = std::min(bMin[a], world[a]);
+				bMax[a] = std::max(bMax[a], world[a]);
+			}
+		}
+
+		return true;
+	}
+
+	// index space box of a grid covering a world space region
+	openvdb::CoordBBox IndexRegion(const openvdb::FloatGrid& grid, const openvdb::Vec3d& bMin, const openvdb::Vec3d& bMax)
+	{
+		openvdb::Vec3d iMin(std::numeric_limits<double>::max());
+		openvdb::Vec3d iMax(-std::numeric_limits<double>::max());
+
+		for (int i = 0; i < 8; i++) {
+			openvdb::Vec3d corner(
+				(i & 1) ? bMax[0] : bMin[0],
+				(i & 2) ? bMax[1] : bMin[1],
+				(i & 4) ? bMax[2] : bMin[2]);
+			openvdb::Vec3d index = grid.worldToIndex(corner);
+			for (int a = 0; a < 3; a++) {
+				iMin[a] = std::min(iMin[a], index[a]);
+				iMax[a] = std::max(iMax[a], index[a]);
+			}
+		}
+
+		return openvdb::CoordBBox(openvdb::Coord::floor(iMin), openvdb::Coord::ceil(iMax));
+	}
+
+	// copy of just the part of a grid inside an index space box. leaves are copied as they are and
+	// tiles at leaf size, so the work scales with the box rather than the whole grid
+	openvdb::FloatGrid::Ptr CopyRegion(const openvdb::FloatGrid& grid, const openvdb::CoordBBox& region)
+	{
+		using LeafT = openvdb::FloatTree::LeafNodeType;
+
+		openvdb::FloatGrid::Ptr part = grid.copyWithNewTree();
+
+		auto acc = grid.getConstAccessor();
+		const float background = grid.background();
+
+		const openvdb::Coord lo(region.min().x() & ~(LeafT::DIM - 1), region.min().y() & ~(LeafT::DIM - 1), region.min().z() & ~(LeafT::DIM - 1));
+		for (int x = lo.x(); x <= region.max().x(); x += LeafT::DIM) {
+			for (int y = lo.y(); y <= region.max().y(); y += LeafT::DIM) {
+				for (int z = lo.z(); z <= region.max().z(); z += LeafT::DIM) {
+					const openvdb::Coord origin(x, y, z);
+
+					if (const LeafT *leaf = acc.probeConstLeaf(origin)) {
+						part->tree().addLeaf(new LeafT(*leaf));
+						continue;
+					}
+
+					const float value = acc.getValue(origin);
+					const bool active = acc.isValueOn(origin);
+					if (active || value != background) {
+						part->tree().addTile(1, origin, value, active);
+					}
+				}
+			}
+		}
+
+		// leaves reach past the box, trim them back to it
+		part->tree().clip(region);
+
+		return part;
+	}
+
+	// index space box for dense copies, index boxes are rounded to the nearest voxels
+	openvdb::CoordBBox DenseRegion(const openvdb::FloatGrid& grid, const openvdb::Vec3d& bMin, const openvdb::Vec3d& bMax, bool world)
+	{
+		if (world) {
+			return IndexRegion(grid, bMin, bMax);
+		}
+
+		return openvdb::CoordBBox(openvdb::Coord::round(bMin), openvdb::Coord::round(bMax));
+	}
+
+	// offsets past the sweep threshold are cheaper to solve again than to track there
+	bool Sweeps(const openvdb::FloatGrid& grid, double amount)
+	{
+		const double threshold = DendroFilter::SweepThreshold();
+		return grid.getGridClass() == openvdb::GRID_LEVEL_SET && threshold >= 0.0 &&
+			std::abs(amount) > threshold * grid.voxelSize()[0];
+	}
+
+	// how far a smooth minimum of two values d apart dips below the hard one, nothing from radius on
+	inline double SmoothMinDip(double d, double radius, int kernel)
+	{
+		if (d >= radius) {
+			return 0.0;
+		}
+
+		if (kernel == DendroGrid::EXPONENTIAL) {
+			// log-sum-exp with a quarter radius falloff, less its tail so the blend ends continuously
+			const double k = 0.25 * radius;
+			return k * (std::log1p(std::exp(-d / k)) - std::log1p(std::exp(-4.0)));
+		}
+
+		const double h = (radius - d) / radius;
+		return 0.25 * radius * h * h;
+	}
+
+	// values of both csg operands over one leaf of the seam, kept from before the csg
+	struct SeamLeaf {
+		openvdb::FloatTree::LeafNodeType target;
+		openvdb::FloatTree::LeafNodeType source;
+	};
+
+	// blended csg value. intersection and difference are smooth minimums of negated operands
+	inline float SmoothComposite(float target, float source, int operation, double radius, int kernel)
+	{
+		const double sign = (operation == DendroCache::UNION) ? 1.0 : -1.0;
+		const double a = sign * target;
+		const double b = (operation == DendroCache::DIFFERENCE) ? source : sign * source;
+
+		return static_cast<float>(sign * (std::min(a, b) - SmoothMinDip(std::abs(a - b), radius, kernel)));
+	}
+
+	// leaves where both bands hold a pair of values close enough to blend. only these are copied, so
+	// the cost follows the seam rather than the size of either operand
+	std::vector<SeamLeaf> FindSeam(const openvdb::FloatGrid& target, const openvdb::FloatGrid& source, int operation, double radius, int kernel)
+	{
+		using LeafT = openvdb::FloatTree::LeafNodeType;
+
+		std::vector<std::pair<const LeafT*, const LeafT*>> pairs;
+		{
+			auto acc = target.getConstAccessor();
+			for (auto it = source.tree().cbeginLeaf(); it; ++it) {
+				if (const LeafT *leaf = acc.probeConstLeaf(it->origin())) {
+					pairs.push_back(std::make_pair(leaf, &(*it)));
+				}
+			}
+		}
+
+		const float tBackground = std::abs(target.background());
+		const float sBackground = std::abs(source.background());
+
+		std::vector<char> used(pairs.size(), 0);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, pairs.size()), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				const LeafT& t = *pairs[n].first;
+				const LeafT& s = *pairs[n].second;
+
+				for (openvdb::Index i = 0; i < LeafT::SIZE && !used[n]; i++) {
+					const float a = t.getValue(i);
+					const float b = s.getValue(i);
+					used[n] = std::abs(a) < tBackground && std::abs(b) < sBackground &&
+						SmoothComposite(a, b, operation, radius, kernel) != SmoothComposite(a, b, operation, 0.0, kernel);
+				}
+			}
+		});
+
+		std::vector<size_t> kept;
+		for (size_t n = 0; n < pairs.size(); n++) {
+			if (used[n]) {
+				kept.push_back(n);
+			}
+		}
+
+		std::vector<SeamLeaf> seam(kept.size());
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, kept.size()), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				seam[n].target = *pairs[kept[n]].first;
+				seam[n].source = *pairs[kept[n]].second;
+			}
+		});
+
+		return seam;
+	}
+
+	// signed distance functions of the analytic primitives in their local frame
+
+	struct SphereDistance {
+		double radius;
+
+		double operator()(const openvdb::Vec3d& p) const
+		{
+			return p.length() - radius;
+		}
+	};
 
-DendroGrid::DendroGrid()
+	// box centered on the origin, size holds half of each side
+	struct BoxDistance {
+		openvdb::Vec3d size;
+
+		double operator()(const openvdb::Vec3d& p) const
+		{
+			const openvdb::Vec3d q(std::abs(p.x()) - size.x(), std::abs(p.y()) - size.y(), std::abs(p.z()) - size.z());
+			const openvdb::Vec3d outside(std::max(q.x(), 0.0), std::max(q.y(), 0.0), std::max(q.z(), 0.0));
+			return outside.length() + std::min(std::max(q.x(), std::max(q.y(), q.z())), 0.0);
+		}
+	};
+
+	// cylinder standing on the xy plane, extruded along +z
+	struct CylinderDistance {
+		double radius, height;
+
+		double operator()(const openvdb::Vec3d& p) const
+		{
+			const double dr = std::sqrt(p.x() * p.x() + p.y() * p.y()) - radius;
+			const double dz = std::abs(p.z() - 0.5 * height) - 0.5 * height;
+			const double outside = std::sqrt(std::max(dr, 0.0) * std::max(dr, 0.0) + std::max(dz, 0.0) * std::max(dz, 0.0));
+			return outside + std::min(std::max(dr, dz), 0.0);
+		}
+	};
+
+	// torus lying in the xy plane
+	struct TorusDistance {
+		double majorRadius, minorRadius;
+
+		double operator()(const openvdb::Vec3d& p) const
+		{
+			const double dr = std::sqrt(p.x() * p.x() + p.y() * p.y()) - majorRadius;
+			return std::sqrt(dr * dr + p.z() * p.z()) - minorRadius;
+		}
+	};
+
+	// capsule around the segment from the origin to height along +z
+	struct CapsuleDistance {
+		double radius, height;
+
+		double operator()(const openvdb::Vec3d& p) const
+		{
+			const double z = p.z() - std::min(std::max(p.z(), 0.0), height);
+			return std::sqrt(p.x() * p.x() + p.y() * p.y() + z * z) - radius;
+		}
+	};
+}
+
+DendroGrid::DendroGrid() : mHash(0), mDisplayRead(0)
 {
-	openvdb::initialize();
+	InitializeOnce();
+	DendroMemory::Instance().Register(this);
 }
 
-DendroGrid::DendroGrid(DendroGrid * grid)
+DendroGrid::DendroGrid(DendroGrid * grid) : mHash(0), mDisplayRead(0)
 {
-	openvdb::initialize();
-	mGrid = grid->Grid()->deepCopy();
-	mDisplay = grid->Display().Duplicate();
+	InitializeOnce();
+
+	{
+		ReadLock lock(grid->mMutex);
+		mGrid = grid->mGrid->deepCopy();
+		mDisplay = grid->mDisplay.Duplicate();
+		mHash.store(grid->mHash.load());
+	}
+
+	DendroMemory::Instance().Register(this);
 }
 
 DendroGrid::~DendroGrid()
 {
+	DendroMemory::Instance().Unregister(this);
 }
 
-openvdb::FloatGrid::Ptr DendroGrid::Grid()
+DendroGrid::WriteLock::WriteLock(DendroGrid * grid, std::vector<DendroGrid*> operands)
 {
+	// a grid passed as its own operand is only locked once, exclusively
+	mLocked.push_back(std::make_pair(grid, true));
+	for (auto it = operands.begin(); it != operands.end(); ++it) {
+		if (*it != grid) {
+			mLocked.push_back(std::make_pair(*it, false));
+		}
+	}
+
+	std::sort(mLocked.begin(), mLocked.end());
+	mLocked.erase(std::unique(mLocked.begin(), mLocked.end(), [](const std::pair<DendroGrid*, bool>& a, const std::pair<DendroGrid*, bool>& b) {
+		return a.first == b.first;
+	}), mLocked.end());
+
+	for (auto it = mLocked.begin(); it != mLocked.end(); ++it) {
+		if (it->second) {
+			it->first->mMutex.lock();
+		}
+		else {
+			it->first->mMutex.lock_shared();
+		}
+	}
+
+	std::vector<DendroGrid*> grids;
+	for (auto it = mLocked.begin(); it != mLocked.end(); ++it) {
+		grids.push_back(it->first);
+	}
+
+	// one use for all grids, so the budget is only enforced once every one of them is released and
+	// never reaches for a grid this thread still holds
+	mUse.reset(new DendroMemory::Use(grids, grid));
+}
+
+DendroGrid::WriteLock::~WriteLock()
+{
+	// grids are measured on release, so that happens while they are still locked
+	mUse.reset();
+
+	for (auto it = mLocked.rbegin(); it != mLocked.rend(); ++it) {
+		if (it->second) {
+			it->first->mMutex.unlock();
+		}
+		else {
+			it->first->mMutex.unlock_shared();
+		}
+	}
+}
+
+openvdb::FloatGrid::Ptr DendroGrid::Grid() const
+{
+	ReadLock lock(mMutex);
 	return mGrid;
 }
 
 bool DendroGrid::Read(const char * vFile)
 {
+	DendroTrace::Span span("DendroGrid::Read");
+	WriteLock lock(this);
+
 	openvdb::io::File file(vFile);
 
 	file.open();
@@ -45,17 +381,24 @@ bool DendroGrid::Read(const char * vFile)
 		return false;
 	}
 
+	// the grid is replaced outright, so one shared with the cache is let go rather than copied
+	DendroTrace::Span phase("readGrid");
 	mGrid = openvdb::gridPtrCast<openvdb::FloatGrid>(file.readGrid(nameIter.gridName()));
+	mHash.store(0);
 
 	return true;
 }
 
-bool DendroGrid::Write(const char * vFile)
+bool DendroGrid::Write(const char * vFile) const
 {
+	DendroTrace::Span span("DendroGrid::Write");
+	ReadLock lock(mMutex);
+
 	openvdb::GridPtrVec grids;
 	grids.push_back(mGrid);
 
 	openvdb::io::File file(vFile);
+	DendroTrace::Span phase("writeGrid");
 	file.write(grids);
 	file.close();
 
@@ -64,30 +407,52 @@ bool DendroGrid::Write(const char * vFile)
 
 bool DendroGrid::CreateFromMesh(DendroMesh vMesh, double voxelSize, double bandwidth)
 {
+	DendroTrace::Span span("DendroGrid::CreateFromMesh");
+	WriteLock lock(this);
+
 	if (!vMesh.IsValid()) {
 		return false;
 	}
 
+	// the grid is replaced outright, so one shared with the cache is let go rather than copied
+	mHash.store(0);
+
 	openvdb::math::Transform xform;
 	xform.preScale(voxelSize);
 
 	auto vertices = vMesh.Vertices();
 	auto faces = vMesh.Faces();
 
-	openvdb::tools::QuadAndTriangleDataAdapter<openvdb::Vec3s, openvdb::Vec4I> mesh(vertices, faces);
-	mGrid = openvdb::tools::meshToVolume<openvdb::FloatGrid>(mesh, xform, static_cast<float>(bandwidth), static_cast<float>(bandwidth), 0, NULL);
+	{
+		DendroTrace::Span phase("meshToVolume");
+		openvdb::tools::QuadAndTriangleDataAdapter<openvdb::Vec3s, openvdb::Vec4I> mesh(vertices, faces);
+		mGrid = openvdb::tools::meshToVolume<openvdb::FloatGrid>(mesh, xform, static_cast<float>(bandwidth), static_cast<float>(bandwidth), 0, NULL);
+	}
 
 	mDisplay = vMesh;
+	mDisplayRead.store(0);
 
 	return true;
 }
 
-bool DendroGrid::CreateFromPoints(DendroParticle vPoints, double voxelSize, double bandwidth)
+bool DendroGrid::CreateFromPoints(const DendroParticle& vPoints, double voxelSize, double bandwidth)
 {
+	DendroTrace::Span span("DendroGrid::CreateFromPoints");
+	WriteLock lock(this);
+
 	if (!vPoints.IsValid()) {
 		return false;
 	}
 
+	// the grid is replaced outright, so one shared with the cache is let go rather than copied
+	mHash.store(0);
+
+	// leaf binned splatting, openvdb is only needed when the points are too spread out to bin
+	mGrid = DendroRaster(voxelSize, bandwidth).Spheres(vPoints);
+	if (mGrid) {
+		return true;
+	}
+
 	mGrid = openvdb::createLevelSet<openvdb::FloatGrid>(voxelSize, bandwidth);
 	openvdb::tools::ParticlesToLevelSet<openvdb::FloatGrid> raster(*mGrid);
 
@@ -95,103 +460,327 @@ bool DendroGrid::CreateFromPoints(DendroParticle vPoints, double voxelSize, doub
 	mGrid->setTransform(xform);
 
 	raster.setGrainSize(1);
-	raster.rasterizeSpheres(vPoints);
-	raster.finalize();
+	{
+		DendroTrace::Span phase("rasterizeSpheres");
+		raster.rasterizeSpheres(vPoints);
+	}
+	{
+		DendroTrace::Span phase("finalize");
+		raster.finalize();
+	}
+
+	return true;
+}
+
+bool DendroGrid::CreateSphere(openvdb::math::Mat4d xform, double radius, double voxelSize, double bandwidth)
+{
+	DendroTrace::Span span("DendroGrid::CreateSphere");
+
+	if (radius <= 0.0) {
+		return false;
+	}
+
+	SphereDistance sphere = { radius };
+	return CreateFromDistance(sphere, openvdb::Vec3d(-radius), openvdb::Vec3d(radius), xform, voxelSize, bandwidth);
+}
+
+bool DendroGrid::CreateBox(openvdb::math::Mat4d xform, double x, double y, double z, double voxelSize, double bandwidth)
+{
+	DendroTrace::Span span("DendroGrid::CreateBox");
+
+	if (x <= 0.0 || y <= 0.0 || z <= 0.0) {
+		return false;
+	}
+
+	const openvdb::Vec3d size(0.5 * x, 0.5 * y, 0.5 * z);
+
+	BoxDistance box = { size };
+	return CreateFromDistance(box, -size, size, xform, voxelSize, bandwidth);
+}
+
+bool DendroGrid::CreateCylinder(openvdb::math::Mat4d xform, double radius, double height, double voxelSize, double bandwidth)
+{
+	DendroTrace::Span span("DendroGrid::CreateCylinder");
+
+	if (radius <= 0.0 || height <= 0.0) {
+		return false;
+	}
+
+	CylinderDistance cylinder = { radius, height };
+	return CreateFromDistance(cylinder, openvdb::Vec3d(-radius, -radius, 0.0), openvdb::Vec3d(radius, radius, height), xform, voxelSize, bandwidth);
+}
+
+bool DendroGrid::CreateTorus(openvdb::math::Mat4d xform, double majorRadius, double minorRadius, double voxelSize, double bandwidth)
+{
+	DendroTrace::Span span("DendroGrid::CreateTorus");
+
+	if (majorRadius <= 0.0 || minorRadius <= 0.0) {
+		return false;
+	}
+
+	const double extent = majorRadius + minorRadius;
+
+	TorusDistance torus = { majorRadius, minorRadius };
+	return CreateFromDistance(torus, openvdb::Vec3d(-extent, -extent, -minorRadius), openvdb::Vec3d(extent, extent, minorRadius), xform, voxelSize, bandwidth);
+}
+
+bool DendroGrid::CreateCapsule(openvdb::math::Mat4d xform, double radius, double height, double voxelSize, double bandwidth)
+{
+	DendroTrace::Span span("DendroGrid::CreateCapsule");
+
+	if (radius <= 0.0 || height < 0.0) {
+		return false;
+	}
+
+	CapsuleDistance capsule = { radius, height };
+	return CreateFromDistance(capsule, openvdb::Vec3d(-radius, -radius, -radius), openvdb::Vec3d(radius, radius, height + radius), xform, voxelSize, bandwidth);
+}
+
+template<typename DistanceT>
+bool DendroGrid::CreateFromDistance(const DistanceT& distance, openvdb::Vec3d bMin, openvdb::Vec3d bMax, openvdb::math::Mat4d xform, double voxelSize, double bandwidth)
+{
+	using LeafT = openvdb::FloatTree::LeafNodeType;
+
+	WriteLock lock(this);
+
+	// local distances are scaled back to world units. this is exact for rigid and uniformly
+	// scaled transforms and an approximation under non-uniform scaling
+	const openvdb::math::Mat3d linear = xform.getMat3();
+	const double det = std::abs(linear.det());
+	if (det <= 0.0 || voxelSize <= 0.0) {
+		return false;
+	}
+
+	double minScale = std::numeric_limits<double>::max(), maxScale = 0.0;
+	for (int i = 0; i < 3; i++) {
+		const double axis = linear.row(i).length();
+		minScale = std::min(minScale, axis);
+		maxScale = std::max(maxScale, axis);
+	}
+
+	const double scale = std::cbrt(det);
+	const openvdb::math::Mat4d inverse = xform.inverse();
+
+	// the grid is replaced outright, so one shared with the cache is let go rather than copied
+	mGrid = openvdb::createLevelSet<openvdb::FloatGrid>(voxelSize, bandwidth);
+	mHash.store(0);
+	mDisplay.Clear();
+	mDisplayRead.store(0);
+
+	const float background = mGrid->background();
+	const double band = voxelSize * bandwidth;
+	const openvdb::math::Transform& transform = mGrid->transform();
+
+	// world space bounds of the transformed primitive padded by the band
+	openvdb::Vec3d wMin(std::numeric_limits<double>::max()), wMax(-std::numeric_limits<double>::max());
+	for (int i = 0; i < 8; i++) {
+		const openvdb::Vec3d corner((i & 1) ? bMax.x() : bMin.x(), (i & 2) ? bMax.y() : bMin.y(), (i & 4) ? bMax.z() : bMin.z());
+		const openvdb::Vec3d w = xform.transform(corner);
+		wMin = openvdb::math::minComponent(wMin, w);
+		wMax = openvdb::math::maxComponent(wMax, w);
+	}
+	wMin -= openvdb::Vec3d(band);
+	wMax += openvdb::Vec3d(band);
+
+	// leaf aligned index range covering the bounds
+	const openvdb::Coord cMin = openvdb::Coord::floor(transform.worldToIndex(wMin));
+	const openvdb::Coord cMax = openvdb::Coord::ceil(transform.worldToIndex(wMax));
+
+	const int dim = LeafT::DIM;
+	openvdb::Coord origin(cMin.x() & ~(dim - 1), cMin.y() & ~(dim - 1), cMin.z() & ~(dim - 1));
+	const openvdb::Coord blocks((cMax.x() - origin.x()) / dim + 1, (cMax.y() - origin.y()) / dim + 1, (cMax.z() - origin.z()) / dim + 1);
+	const size_t blockCount = size_t(blocks.x()) * size_t(blocks.y()) * size_t(blocks.z());
+
+	// a block is skipped when its center is further from the surface than the band plus its own half diagonal
+	const double cull = band + 0.5 * std::sqrt(3.0) * dim * voxelSize * (maxScale / minScale);
+
+	std::vector<LeafT*> leaves(blockCount, nullptr);
+
+	DendroTrace::Span evaluate("evaluate distance");
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, blockCount), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			const openvdb::Coord block(
+				origin.x() + dim * static_cast<int>(n % blocks.x()),
+				origin.y() + dim * static_cast<int>((n / blocks.x()) % blocks.y()),
+				origin.z() + dim * static_cast<int>(n / (size_t(blocks.x()) * blocks.y())));
+
+			const openvdb::Vec3d center = transform.indexToWorld(block.asVec3d() + openvdb::Vec3d(0.5 * (dim - 1)));
+			if (std::abs(distance(inverse.transform(center)) * scale) > cull) {
+				continue;
+			}
+
+			LeafT *leaf = new LeafT(block, background);
+			for (openvdb::Index offset = 0; offset < LeafT::SIZE; offset++) {
+				const openvdb::Vec3d p = transform.indexToWorld(leaf->offsetToGlobalCoord(offset));
+				const double d = distance(inverse.transform(p)) * scale;
+
+				if (std::abs(d) < band) {
+					leaf->setValueOn(offset, static_cast<float>(d));
+				}
+				else {
+					leaf->setValueOff(offset, (d > 0.0) ? background : -background);
+				}
+			}
+
+			if (leaf->isEmpty()) {
+				delete leaf;
+			}
+			else {
+				leaves[n] = leaf;
+			}
+		}
+	});
+
+	for (auto it = leaves.begin(); it != leaves.end(); ++it) {
+		if (*it != nullptr) {
+			mGrid->tree().addLeaf(*it);
+		}
+	}
+
+	// mark the interior with negative background tiles
+	DendroTrace::Span fill("signedFloodFill");
+	openvdb::tools::signedFloodFill(mGrid->tree());
 
 	return true;
 }
 
 void DendroGrid::Transform(openvdb::math::Mat4d xform)
 {
+	DendroTrace::Span span("DendroGrid::Transform");
+	WriteLock lock(this);
+
+	BeginEdit();
+
 	mGrid->transform().postMult(xform);
 }
 
-void DendroGrid::BooleanUnion(DendroGrid vAdd)
+void DendroGrid::BooleanUnion(DendroGrid& vAdd)
 {
-	auto csgGrid = vAdd.Grid();
+	DendroTrace::Span span("DendroGrid::BooleanUnion");
+	WriteLock lock(this, { &vAdd });
 
-	// store current tranforms of both csg volumes
-	const openvdb::math::Transform
-		&sourceXform = csgGrid->transform(),
-		&targetXform = mGrid->transform();
+	DendroCache::Key key = CacheKey(DendroCache::UNION, { &vAdd }, {});
+	if (FromCache(key)) {
+		return;
+	}
 
-	// create a copy of the source grid for resampling
-	openvdb::FloatGrid::Ptr cGrid = openvdb::createLevelSet<openvdb::FloatGrid>(mGrid->voxelSize()[0]);
-	cGrid->transform() = mGrid->transform();
+	BeginEdit();
 
-	// compute a source grid to target grid transform
-	openvdb::Mat4R xform =
-		sourceXform.baseMap()->getAffineMap()->getMat4() *
-		targetXform.baseMap()->getAffineMap()->getMat4().inverse();
+	Composite(vAdd, DendroCache::UNION, 0.0, POLYNOMIAL);
 
-	// create the transformer
-	openvdb::tools::GridTransformer transformer(xform);
+	ToCache(key);
+}
 
-	// resample using trilinear interpolation 
-	transformer.transformGrid<openvdb::tools::BoxSampler, openvdb::FloatGrid>(*csgGrid, *cGrid);
+void DendroGrid::BooleanUnion(DendroGrid& vAdd, double radius, int kernel)
+{
+	DendroTrace::Span span("DendroGrid::BooleanUnion");
+	WriteLock lock(this, { &vAdd });
 
-	// solve for the csg operation with result being stored in mGrid
-	openvdb::tools::csgUnion(*mGrid, *cGrid, true);
+	DendroCache::Key key = CacheKey(DendroCache::UNION, { &vAdd }, { radius, double(kernel) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	BeginEdit();
+
+	Composite(vAdd, DendroCache::UNION, radius, kernel);
+
+	ToCache(key);
 }
 
-void DendroGrid::BooleanIntersection(DendroGrid vIntersect)
+void DendroGrid::BooleanIntersection(DendroGrid& vIntersect)
 {
-	auto csgGrid = vIntersect.Grid();
+	DendroTrace::Span span("DendroGrid::BooleanIntersection");
+	WriteLock lock(this, { &vIntersect });
 
-	// store current tranforms of both csg volumes
-	const openvdb::math::Transform
-		&sourceXform = csgGrid->transform(),
-		&targetXform = mGrid->transform();
+	DendroCache::Key key = CacheKey(DendroCache::INTERSECTION, { &vIntersect }, {});
+	if (FromCache(key)) {
+		return;
+	}
 
-	// create a copy of the source grid for resampling
-	openvdb::FloatGrid::Ptr cGrid = openvdb::createLevelSet<openvdb::FloatGrid>(mGrid->voxelSize()[0]);
-	cGrid->transform() = mGrid->transform();
+	BeginEdit();
 
-	// compute a source grid to target grid transform
-	openvdb::Mat4R xform =
-		sourceXform.baseMap()->getAffineMap()->getMat4() *
-		targetXform.baseMap()->getAffineMap()->getMat4().inverse();
+	Composite(vIntersect, DendroCache::INTERSECTION, 0.0, POLYNOMIAL);
 
-	// create the transformer
-	openvdb::tools::GridTransformer transformer(xform);
+	ToCache(key);
+}
 
-	// resample using trilinear interpolation 
-	transformer.transformGrid<openvdb::tools::BoxSampler, openvdb::FloatGrid>(*csgGrid, *cGrid);
+void DendroGrid::BooleanIntersection(DendroGrid& vIntersect, double radius, int kernel)
+{
+	DendroTrace::Span span("DendroGrid::BooleanIntersection");
+	WriteLock lock(this, { &vIntersect });
 
-	// solve for the csg operation with result being stored in mGrid
-	openvdb::tools::csgIntersection(*mGrid, *cGrid, true);
+	DendroCache::Key key = CacheKey(DendroCache::INTERSECTION, { &vIntersect }, { radius, double(kernel) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	BeginEdit();
+
+	Composite(vIntersect, DendroCache::INTERSECTION, radius, kernel);
+
+	ToCache(key);
 }
 
-void DendroGrid::BooleanDifference(DendroGrid vSubtract)
+void DendroGrid::BooleanDifference(DendroGrid& vSubtract)
 {
-	auto csgGrid = vSubtract.Grid();
+	DendroTrace::Span span("DendroGrid::BooleanDifference");
+	WriteLock lock(this, { &vSubtract });
 
-	// store current tranforms of both csg volumes
-	const openvdb::math::Transform
-		&sourceXform = csgGrid->transform(),
-		&targetXform = mGrid->transform();
+	DendroCache::Key key = CacheKey(DendroCache::DIFFERENCE, { &vSubtract }, {});
+	if (FromCache(key)) {
+		return;
+	}
 
-	// create a copy of the source grid for resampling
-	openvdb::FloatGrid::Ptr cGrid = openvdb::createLevelSet<openvdb::FloatGrid>(mGrid->voxelSize()[0]);
-	cGrid->transform() = mGrid->transform();
+	BeginEdit();
 
-	// compute a source grid to target grid transform
-	openvdb::Mat4R xform =
-		sourceXform.baseMap()->getAffineMap()->getMat4() *
-		targetXform.baseMap()->getAffineMap()->getMat4().inverse();
+	Composite(vSubtract, DendroCache::DIFFERENCE, 0.0, POLYNOMIAL);
 
-	// create the transformer
-	openvdb::tools::GridTransformer transformer(xform);
+	ToCache(key);
+}
 
-	// resample using trilinear interpolation 
-	transformer.transformGrid<openvdb::tools::BoxSampler, openvdb::FloatGrid>(*csgGrid, *cGrid);
+void DendroGrid::BooleanDifference(DendroGrid& vSubtract, double radius, int kernel)
+{
+	DendroTrace::Span span("DendroGrid::BooleanDifference");
+	WriteLock lock(this, { &vSubtract });
 
-	// solve for the csg operation with result being stored in mGrid
-	openvdb::tools::csgDifference(*mGrid, *cGrid, true);
+	DendroCache::Key key = CacheKey(DendroCache::DIFFERENCE, { &vSubtract }, { radius, double(kernel) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	BeginEdit();
+
+	Composite(vSubtract, DendroCache::DIFFERENCE, radius, kernel);
+
+	ToCache(key);
 }
 
 void DendroGrid::Offset(double amount)
 {
+	DendroTrace::Span span("DendroGrid::Offset");
+	WriteLock lock(this);
+
+	const bool sweep = Sweeps(*mGrid, amount);
+
+	DendroCache::Key key = CacheKey(DendroCache::OFFSET, {}, { amount, double(sweep) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	if (sweep) {
+		// the sweep only reads the grid and builds a new one, so a shared grid is not copied first
+		openvdb::FloatGrid::Ptr result = DendroFilter::Sweep(*mGrid, amount);
+		if (result) {
+			mGrid = result;
+			mHash.store(0);
+			ToCache(key);
+			return;
+		}
+	}
+
+	BeginEdit();
+
 	// create a new filter to operate on grid with
 	openvdb::tools::LevelSetFilter<openvdb::FloatGrid> filter(*mGrid);
 
@@ -200,11 +789,37 @@ void DendroGrid::Offset(double amount)
 	amount = amount * -1;
 
 	// apply offset to grid of supplied amount
+	DendroTrace::Span phase("LevelSetFilter::offset");
 	filter.offset((float)amount);
+
+	ToCache(key);
 }
 
-void DendroGrid::Offset(double amount, DendroGrid vMask, double min, double max, bool invert)
+void DendroGrid::Offset(double amount, DendroGrid& vMask, double min, double max, bool invert)
 {
+	DendroTrace::Span span("DendroGrid::Offset (masked)");
+	WriteLock lock(this, { &vMask });
+
+	const bool sweep = Sweeps(*mGrid, amount);
+
+	DendroCache::Key key = CacheKey(DendroCache::OFFSET_MASK, { &vMask }, { amount, min, max, double(invert), double(sweep) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	if (sweep) {
+		// the sweep only reads the grid and builds a new one, so a shared grid is not copied first
+		openvdb::FloatGrid::Ptr result = DendroFilter::Sweep(*mGrid, amount, vMask.mGrid.get(), min, max, invert);
+		if (result) {
+			mGrid = result;
+			mHash.store(0);
+			ToCache(key);
+			return;
+		}
+	}
+
+	BeginEdit();
+
 	// create a new filter to operate on grid with
 	openvdb::tools::LevelSetFilter<openvdb::FloatGrid> filter(*mGrid);
 
@@ -213,22 +828,55 @@ void DendroGrid::Offset(double amount, DendroGrid vMask, double min, double max,
 	filter.setGrainSize(1);
 
 	// create filter mask
-	openvdb::Grid<openvdb::FloatTree> mMask(*vMask.Grid());
+	openvdb::Grid<openvdb::FloatTree> mMask(*vMask.mGrid);
 
 	amount = amount * -1;
 
 	// apply offset to grid of supplied amount
+	DendroTrace::Span phase("LevelSetFilter::offset");
 	filter.offset((float)amount, &mMask);
+
+	ToCache(key);
 }
 
 void DendroGrid::Smooth(int type, int iterations, int width)
 {
+	DendroTrace::Span span("DendroGrid::Smooth");
+	WriteLock lock(this);
+
+	// the dense engine only covers mean and gaussian, it is part of the key as results differ in the last bits
+	const bool dense = (type == 0 || type == 2) && DendroFilter::ActiveEngine() == DendroFilter::DENSE;
+
+	DendroCache::Key key = CacheKey(DendroCache::SMOOTH, {}, { double(type), double(iterations), double(width), double(dense) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	BeginEdit();
+
+	if (dense) {
+		DendroFilter filter(*mGrid);
+
+		for (int i = 0; i < iterations; i++) {
+			if (type == 0) {
+				filter.Gaussian(width);
+			}
+			else {
+				filter.Mean(width);
+			}
+		}
+
+		ToCache(key);
+		return;
+	}
+
 	// create a new filter to operate on grid with
 	openvdb::tools::LevelSetFilter<openvdb::FloatGrid> filter(*mGrid);
 	filter.setGrainSize(1);
 
 	// apply filter for the number iterations supplied
 	for (int i = 0; i < iterations; i++) {
+		DendroTrace::Span pass("LevelSetFilter pass");
 
 		// filter by desired type supplied
 		switch (type) {
@@ -249,10 +897,22 @@ void DendroGrid::Smooth(int type, int iterations, int width)
 			break;
 		}
 	}
+
+	ToCache(key);
 }
 
-void DendroGrid::Smooth(int type, int iterations, int width, DendroGrid vMask, double min, double max, bool invert)
+void DendroGrid::Smooth(int type, int iterations, int width, DendroGrid& vMask, double min, double max, bool invert)
 {
+	DendroTrace::Span span("DendroGrid::Smooth (masked)");
+	WriteLock lock(this, { &vMask });
+
+	DendroCache::Key key = CacheKey(DendroCache::SMOOTH_MASK, { &vMask }, { double(type), double(iterations), double(width), min, max, double(invert) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	BeginEdit();
+
 	// create a new filter to operate on grid with
 	openvdb::tools::LevelSetFilter<openvdb::FloatGrid> filter(*mGrid);
 
@@ -261,10 +921,11 @@ void DendroGrid::Smooth(int type, int iterations, int width, DendroGrid vMask, d
 	filter.setGrainSize(1);
 
 	// create filter mask
-	openvdb::Grid<openvdb::FloatTree> mMask(*vMask.Grid());
+	openvdb::Grid<openvdb::FloatTree> mMask(*vMask.mGrid);
 
 	// apply filter for the number iterations supplied
 	for (int i = 0; i < iterations; i++) {
+		DendroTrace::Span pass("LevelSetFilter pass");
 
 		// filter by desired type supplied
 		switch (type) {
@@ -285,11 +946,23 @@ void DendroGrid::Smooth(int type, int iterations, int width, DendroGrid vMask, d
 			break;
 		}
 	}
+
+	ToCache(key);
 }
 
-void DendroGrid::Blend(DendroGrid bGrid, double bPosition, double bEnd)
+void DendroGrid::Blend(DendroGrid& bGrid, double bPosition, double bEnd)
 {
-	openvdb::tools::LevelSetMorphing<openvdb::FloatGrid> morph(*mGrid, *bGrid.Grid());
+	DendroTrace::Span span("DendroGrid::Blend");
+	WriteLock lock(this, { &bGrid });
+
+	DendroCache::Key key = CacheKey(DendroCache::BLEND, { &bGrid }, { bPosition, bEnd });
+	if (FromCache(key)) {
+		return;
+	}
+
+	BeginEdit();
+
+	openvdb::tools::LevelSetMorphing<openvdb::FloatGrid> morph(*mGrid, *bGrid.mGrid);
 	morph.setSpatialScheme(openvdb::math::HJWENO5_BIAS);
 	morph.setTemporalScheme(openvdb::math::TVD_RK3);
 	morph.setTrackerSpatialScheme(openvdb::math::HJWENO5_BIAS);
@@ -297,141 +970,663 @@ void DendroGrid::Blend(DendroGrid bGrid, double bPosition, double bEnd)
 	morph.setGrainSize(1);
 
 	double bStart = bPosition * bEnd;
+	DendroTrace::Span phase("LevelSetMorphing::advect");
 	morph.advect(bStart, bEnd);
+
+	ToCache(key);
 }
 
-void DendroGrid::Blend(DendroGrid bGrid, double bPosition, double bEnd, DendroGrid vMask, double mMin, double mMax, bool invert)
+void DendroGrid::Blend(DendroGrid& bGrid, double bPosition, double bEnd, DendroGrid& vMask, double mMin, double mMax, bool invert)
 {
-	openvdb::tools::LevelSetMorphing<openvdb::FloatGrid> morph(*mGrid, *bGrid.Grid());
+	DendroTrace::Span span("DendroGrid::Blend (masked)");
+	WriteLock lock(this, { &bGrid, &vMask });
+
+	DendroCache::Key key = CacheKey(DendroCache::BLEND_MASK, { &bGrid, &vMask }, { bPosition, bEnd, mMin, mMax, double(invert) });
+	if (FromCache(key)) {
+		return;
+	}
+
+	BeginEdit();
+
+	openvdb::tools::LevelSetMorphing<openvdb::FloatGrid> morph(*mGrid, *bGrid.mGrid);
 	morph.setSpatialScheme(openvdb::math::HJWENO5_BIAS);
 	morph.setTemporalScheme(openvdb::math::TVD_RK3);
 	morph.setTrackerSpatialScheme(openvdb::math::HJWENO5_BIAS);
 	morph.setTrackerTemporalScheme(openvdb::math::TVD_RK2);
 
-	morph.setAlphaMask(*vMask.Grid());
+	morph.setAlphaMask(*vMask.mGrid);
 	morph.invertMask(invert);
 	morph.setMaskRange((float)mMin, (float)mMax);
 	morph.setGrainSize(1);
 
 	double bStart = bPosition * bEnd;
+	DendroTrace::Span phase("LevelSetMorphing::advect");
 	morph.advect(bStart, bEnd);
+
+	ToCache(key);
+}
+
+uint64_t DendroGrid::Hash() const
+{
+	DendroTrace::Span span("DendroGrid::Hash");
+	ReadLock lock(mMutex);
+
+	return ContentHash();
+}
+
+uint64_t DendroGrid::ContentHash() const
+{
+	if (!mGrid) {
+		return 0;
+	}
+
+	// zero marks a stale hash, so a computed zero is nudged to one
+	uint64_t hash = mHash.load();
+	if (hash == 0) {
+		DendroTrace::Span phase("HashGrid");
+		hash = DendroCache::HashGrid(*mGrid);
+		hash = (hash == 0) ? 1 : hash;
+		mHash.store(hash);
+	}
+
+	return hash;
+}
+
+void DendroGrid::Compact(double halfWidth)
+{
+	DendroTrace::Span span("DendroGrid::Compact");
+	WriteLock lock(this);
+
+	BeginEdit();
+	CompactGrid(halfWidth);
+
+	// an explicit compaction also frees the display mesh, callers have read it back by now
+	ReleaseCaches();
+}
+
+size_t DendroGrid::MemoryUsage() const
+{
+	DendroTrace::Span span("DendroGrid::MemoryUsage");
+	ReadLock lock(mMutex);
+
+	return Measure();
+}
+
+size_t DendroGrid::Measure() const
+{
+	size_t bytes = mDisplay.MemoryUsage();
+
+	if (mGrid) {
+		bytes += static_cast<size_t>(mGrid->memUsage());
+	}
+
+	return bytes;
+}
+
+DendroCache::Key DendroGrid::CacheKey(int operation, std::vector<DendroGrid*> operands, std::vector<double> parameters)
+{
+	DendroCache::Key key;
+	key.operation = operation;
+
+	// inputs are only hashed while the cache is enabled, an empty key is never looked up
+	if (DendroCache::Instance().Enabled() && mGrid) {
+		key.inputs.push_back(ContentHash());
+		for (auto it = operands.begin(); it != operands.end(); ++it) {
+			key.inputs.push_back((*it)->ContentHash());
+		}
+		key.parameters = parameters;
+	}
+
+	return key;
+}
+
+bool DendroGrid::FromCache(const DendroCache::Key& key)
+{
+	if (key.inputs.empty()) {
+		return false;
+	}
+
+	DendroTrace::Span span("cache lookup");
+
+	openvdb::FloatGrid::Ptr result = DendroCache::Instance().Find(key);
+	if (!result) {
+		return false;
+	}
+
+	// the result is shared with the cache until this grid is next edited
+	mGrid = result;
+	mHash.store(0);
+
+	return true;
+}
+
+void DendroGrid::ToCache(const DendroCache::Key& key)
+{
+	if (!key.inputs.empty()) {
+		DendroCache::Instance().Insert(key, mGrid);
+	}
 }
 
-void DendroGrid::ClosestPoint(std::vector<openvdb::Vec3R>& points, std::vector<float>& distances)
+void DendroGrid::BeginEdit()
 {
+	// grids handed out by the cache are shared, copy before editing in place
+	if (mGrid && mGrid.use_count() > 1) {
+		DendroTrace::Span span("copy on write");
+		mGrid = mGrid->deepCopy();
+	}
+
+	mHash.store(0);
+}
+
+void DendroGrid::Composite(DendroGrid& operand, int operation, double radius, int kernel)
+{
+	auto csgGrid = operand.mGrid;
+
+	openvdb::Vec3d tMin, tMax, sMin, sMax;
+	bool hasTarget = ActiveWorldBounds(*mGrid, tMin, tMax);
+	bool hasSource = ActiveWorldBounds(*csgGrid, sMin, sMax);
+
+	// region where both narrow bands can interact
+	openvdb::Vec3d oMin, oMax;
+	bool overlaps = hasTarget && hasSource;
+	for (int a = 0; overlaps && a < 3; a++) {
+		oMin[a] = std::max(tMin[a], sMin[a]);
+		oMax[a] = std::min(tMax[a], sMax[a]);
+		overlaps = oMin[a] <= oMax[a];
+	}
+
+	if (!overlaps) {
+		// disjoint volumes, only a union has anything left to add
+		if (operation == DendroCache::INTERSECTION) {
+			mGrid->tree().clear();
+			return;
+		}
+		if (operation != DendroCache::UNION || !hasSource) {
+			return;
+		}
+	}
+
+	// an intersection or difference only changes the overlap, clip both sides to it
+	// before resampling. the pad keeps the band whole where it crosses the region edge
+	openvdb::FloatGrid::Ptr clipped;
+	if (overlaps && operation != DendroCache::UNION) {
+		double pad = std::max(mGrid->background(), csgGrid->background());
+		oMin -= openvdb::Vec3d(pad);
+		oMax += openvdb::Vec3d(pad);
+
+		DendroTrace::Span phase("clip to overlap");
+
+		clipped = CopyRegion(*csgGrid, IndexRegion(*csgGrid, oMin, oMax));
+
+		if (operation == DendroCache::INTERSECTION) {
+			mGrid->tree().clip(IndexRegion(*mGrid, oMin, oMax));
+		}
+	}
+
+	const openvdb::FloatGrid& source = clipped ? *clipped : *csgGrid;
+
+	// store current tranforms of both csg volumes
+	const openvdb::math::Transform
+		&sourceXform = source.transform(),
+		&targetXform = mGrid->transform();
+
+	openvdb::FloatGrid::Ptr cGrid;
+	if (sourceXform == targetXform) {
+		// matching transforms need no resampling, csg only needs a grid it may consume
+		DendroTrace::Span phase("copy operand");
+		cGrid = clipped ? clipped : csgGrid->deepCopy();
+	}
+	else {
+		// resample into a grid keeping the source band width rather than the default
+		double voxelSize = mGrid->voxelSize()[0];
+		cGrid = openvdb::createLevelSet<openvdb::FloatGrid>(voxelSize, source.background() / voxelSize);
+		cGrid->transform() = mGrid->transform();
+
+		// compute a source grid to target grid transform
+		openvdb::Mat4R xform =
+			sourceXform.baseMap()->getAffineMap()->getMat4() *
+			targetXform.baseMap()->getAffineMap()->getMat4().inverse();
+
+		// create the transformer
+		openvdb::tools::GridTransformer transformer(xform);
+
+		// resample using trilinear interpolation
+		DendroTrace::Span phase("GridTransformer");
+		transformer.transformGrid<openvdb::tools::BoxSampler, openvdb::FloatGrid>(source, *cGrid);
+	}
+
+	// the csg consumes both operands, so the seam is copied out first. a fillet has to lie inside
+	// both bands to be represented at all, which caps the radius at the narrower one
+	const float tBackground = std::abs(mGrid->background());
+	const float sBackground = std::abs(cGrid->background());
+
+	std::vector<SeamLeaf> seam;
+	if (radius > 0.0 && mGrid->getGridClass() == openvdb::GRID_LEVEL_SET) {
+		radius = std::min(radius, double(std::min(tBackground, sBackground)));
+
+		DendroTrace::Span phase("find seam");
+		seam = FindSeam(*mGrid, *cGrid, operation, radius, kernel);
+	}
+
+	// solve for the csg operation with result being stored in mGrid
+	if (operation == DendroCache::UNION) {
+		DendroTrace::Span phase("csgUnion");
+		openvdb::tools::csgUnion(*mGrid, *cGrid, true);
+	}
+	else if (operation == DendroCache::INTERSECTION) {
+		DendroTrace::Span phase("csgIntersection");
+		openvdb::tools::csgIntersection(*mGrid, *cGrid, true);
+	}
+	else {
+		DendroTrace::Span phase("csgDifference");
+		openvdb::tools::csgDifference(*mGrid, *cGrid, true);
+	}
+
+	if (seam.empty()) {
+		return;
+	}
+
+	// one pass over the seam replaces the hard result with the blended one, nothing else is touched
+	DendroTrace::Span phase("blend seam");
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, seam.size()), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			openvdb::FloatTree::LeafNodeType *leaf = mGrid->tree().probeLeaf(seam[n].target.origin());
+			if (!leaf) {
+				continue;
+			}
+
+			for (openvdb::Index i = 0; i < openvdb::FloatTree::LeafNodeType::SIZE; i++) {
+				const float a = seam[n].target.getValue(i);
+				const float b = seam[n].source.getValue(i);
+				if (!(std::abs(a) < tBackground && std::abs(b) < sBackground)) {
+					continue;
+				}
+
+				const float value = SmoothComposite(a, b, operation, radius, kernel);
+				if (value == SmoothComposite(a, b, operation, 0.0, kernel)) {
+					continue;
+				}
+
+				const float clamped = std::min(std::max(value, -tBackground), tBackground);
+				if (std::abs(clamped) < tBackground) {
+					leaf->setValueOn(i, clamped);
+				}
+				else {
+					leaf->setValueOnly(i, clamped);
+				}
+			}
+		}
+	});
+
+	// smooth min values are not distances, so the seam is renormalized to leave a signed distance
+	// field for later filters. the mask keeps the solve to the seam leaves
+	DendroTrace::Span normalize("normalize seam");
+
+	openvdb::MaskTree mask;
+	for (auto it = seam.begin(); it != seam.end(); ++it) {
+		mask.touchLeaf(it->target.origin())->setValuesOn();
+	}
+
+	openvdb::tools::LevelSetTracker<openvdb::FloatGrid> tracker(*mGrid);
+	tracker.normalize(&mask);
+}
+
+void DendroGrid::ReleaseCaches()
+{
+	// swapping with an empty mesh frees the buffers instead of just clearing them
+	mDisplay = DendroMesh();
+	mDisplayRead.store(0);
+}
+
+bool DendroGrid::DisplayRead() const
+{
+	return mDisplayRead.load() == 7;
+}
+
+void DendroGrid::CompactGrid(double halfWidth)
+{
+	// a grid still shared with the result cache is left as is, compacting it would edit the cached copy
+	if (mGrid && mGrid.use_count() == 1) {
+		DendroTrace::Span span("compact grid");
+
+		mHash.store(0);
+
+		if (mGrid->getGridClass() == openvdb::GRID_LEVEL_SET) {
+			// background over voxel size is rarely exact, and resize rounds it down, so a band that is
+			// a hair short of its width would be dilated by a voxel on every compaction
+			const double current = mGrid->background() / mGrid->voxelSize()[0];
+
+			// a non-positive width keeps the band the grid already has
+			const double width = (halfWidth <= 0.0) ? std::max(1.0, std::round(current)) : std::max(1.0, std::ceil(halfWidth));
+
+			// rebuild the narrow band to the requested width only if it differs, dropping band voxels past it
+			if (std::abs(current - width) > 1e-3) {
+				openvdb::tools::LevelSetTracker<openvdb::FloatGrid> tracker(*mGrid);
+				tracker.resize(static_cast<openvdb::Index>(width));
+			}
+
+			openvdb::tools::pruneLevelSet(mGrid->tree());
+		}
+		else {
+			openvdb::tools::pruneInactive(mGrid->tree());
+		}
+
+		mGrid->tree().clearAllAccessors();
+	}
+}
+
+void DendroGrid::ClosestPoint(std::vector<openvdb::Vec3R>& points, std::vector<float>& distances) const
+{
+	DendroTrace::Span span("DendroGrid::ClosestPoint");
+	ReadLock lock(mMutex);
+
 	auto csp = openvdb::tools::ClosestSurfacePoint<openvdb::FloatGrid>::create(*mGrid);
 	csp->searchAndReplace(points, distances);
 }
 
-DendroMesh DendroGrid::Display()
+void DendroGrid::Slice(openvdb::Vec3d origin, openvdb::Vec3d normal, double spacing, int count, double isovalue, std::vector<float>& vertices, std::vector<int>& contours) const
+{
+	DendroTrace::Span span("DendroGrid::Slice");
+	ReadLock lock(mMutex);
+
+	// same isovalue scaling as the display mesh, so contours match the mesh for the same setting
+	isovalue /= mGrid->voxelSize().x();
+
+	DendroSlice slicer(*mGrid, isovalue);
+	slicer.Stack(origin, normal, spacing, count, vertices, contours);
+}
+
+DendroMesh DendroGrid::Display() const
 {
+	DendroTrace::Span span("DendroGrid::Display");
+	ReadLock lock(mMutex);
+
 	return mDisplay;
 }
 
 void DendroGrid::UpdateDisplay()
 {
+	DendroTrace::Span span("DendroGrid::UpdateDisplay");
+	WriteLock lock(this);
+
 	using openvdb::Index64;
 
 	openvdb::tools::VolumeToMesh mesher(mGrid->getGridClass() == openvdb::GRID_LEVEL_SET ? 0.0 : 0.01);
-	mesher(*mGrid);
-
-	mDisplay.Clear();
-
-	for (Index64 n = 0, i = 0, N = mesher.pointListSize(); n < N; ++n)
 	{
-		auto v = mesher.pointList()[n];
-		mDisplay.AddVertice(v);
+		DendroTrace::Span phase("VolumeToMesh");
+		mesher(*mGrid);
 	}
 
-	openvdb::tools::PolygonPoolList &polygonPoolList = mesher.polygonPoolList();
-
-	for (Index64 n = 0, N = mesher.polygonPoolListSize(); n < N; ++n)
 	{
-		const openvdb::tools::PolygonPool &polygons = polygonPoolList[n];
-		for (Index64 i = 0, I = polygons.numQuads(); i < I; ++i)
+		DendroTrace::Span copy("copy polygons");
+
+		mDisplay.Clear();
+		mDisplayRead.store(0);
+
+		for (Index64 n = 0, i = 0, N = mesher.pointListSize(); n < N; ++n)
 		{
-			auto face = polygons.quad(i);
-			mDisplay.AddFace(face);
+			auto v = mesher.pointList()[n];
+			mDisplay.AddVertice(v);
+		}
+
+		openvdb::tools::PolygonPoolList &polygonPoolList = mesher.polygonPoolList();
+
+		for (Index64 n = 0, N = mesher.polygonPoolListSize(); n < N; ++n)
+		{
+			const openvdb::tools::PolygonPool &polygons = polygonPoolList[n];
+			for (Index64 i = 0, I = polygons.numQuads(); i < I; ++i)
+			{
+				auto face = polygons.quad(i);
+				mDisplay.AddFace(face);
+			}
+
+			for (Index64 i = 0, I = polygons.numTriangles(); i < I; ++i)
+			{
+				auto tri = polygons.triangle(i);
+				openvdb::Vec4I face(tri.x(), tri.y(), tri.z(), openvdb::util::INVALID_IDX);
+				mDisplay.AddFace(face);
+			}
 		}
 	}
+
+	FinalizeMesh(mDisplay, 0.0, 0, 0.0);
 }
 
 void DendroGrid::UpdateDisplay(double isovalue, double adaptivity)
 {
+	DendroTrace::Span span("DendroGrid::UpdateDisplay");
+
+	UpdateDisplay(isovalue, adaptivity, 0, 0.0);
+}
+
+void DendroGrid::UpdateDisplay(double isovalue, double adaptivity, int targetFaces, double maxError)
+{
+	DendroTrace::Span span("DendroGrid::UpdateDisplay");
+	WriteLock lock(this);
+
+	mDisplay = BuildMesh(isovalue, adaptivity, targetFaces, maxError);
+	mDisplayRead.store(0);
+}
+
+DendroMesh DendroGrid::Mesh(double isovalue, double adaptivity, int targetFaces, double maxError) const
+{
+	DendroTrace::Span span("DendroGrid::Mesh");
+	ReadLock lock(mMutex);
+
+	return BuildMesh(isovalue, adaptivity, targetFaces, maxError);
+}
+
+bool DendroGrid::Export(const char * path, int format, double isovalue, double adaptivity) const
+{
+	DendroTrace::Span span("DendroGrid::Export");
+	ReadLock lock(mMutex);
+
+	if (!mGrid) {
+		return false;
+	}
+
+	// same isovalue scaling as the display mesh
 	isovalue /= mGrid->voxelSize().x();
 
-	std::vector<openvdb::Vec3s> points;
-	std::vector<openvdb::Vec4I> quads;
-	std::vector<openvdb::Vec3I> triangles;
+	DendroExport exporter(*mGrid, isovalue, adaptivity);
+	return exporter.Write(path, format);
+}
 
-	openvdb::tools::volumeToMesh<openvdb::FloatGrid>(*mGrid, points, triangles, quads, isovalue, adaptivity);
+bool DendroGrid::ToDense(openvdb::Vec3d bMin, openvdb::Vec3d bMax, bool world, int step, float * buffer, const int64_t * strides, int * dims) const
+{
+	DendroTrace::Span span("DendroGrid::ToDense");
+	ReadLock lock(mMutex);
 
-	mDisplay.Clear();
+	if (!mGrid || step < 1) {
+		return false;
+	}
 
-	mDisplay.AddVertice(points);
+	const openvdb::CoordBBox bbox = DenseRegion(*mGrid, bMin, bMax, world);
+	if (bbox.empty()) {
+		return false;
+	}
 
-	auto begin = triangles.begin();
-	auto end = triangles.end();
+	DendroDense dense(bbox, step, strides);
 
-	for (auto it = begin; it != end; ++it) {
-		int w = -1;
-		int x = it->x();
-		int y = it->y();
-		int z = it->z();
+	const openvdb::Coord size = dense.Dims();
+	dims[0] = size.x();
+	dims[1] = size.y();
+	dims[2] = size.z();
 
-		openvdb::Vec4I face(x,y,z,w);
+	if (buffer) {
+		dense.Read(*mGrid, buffer);
+	}
 
-		mDisplay.AddFace(face);
+	return true;
+}
+
+bool DendroGrid::FromDense(openvdb::Vec3d bMin, openvdb::Vec3d bMax, bool world, int step, const float * buffer, const int64_t * strides, double threshold)
+{
+	DendroTrace::Span span("DendroGrid::FromDense");
+	WriteLock lock(this);
+
+	if (!mGrid || !buffer || step < 1) {
+		return false;
+	}
+
+	const openvdb::CoordBBox bbox = DenseRegion(*mGrid, bMin, bMax, world);
+	if (bbox.empty()) {
+		return false;
 	}
 
-	mDisplay.AddFace(quads);
+	BeginEdit();
+	WriteDense(bbox, step, buffer, strides, threshold);
+
+	return true;
 }
 
-float * DendroGrid::GetMeshVertices()
+bool DendroGrid::FromDense(openvdb::Vec3d bMin, openvdb::Vec3d bMax, bool world, int step, const float * buffer, int64_t size, const int64_t * strides, double threshold, double voxelSize, double bandwidth, bool levelSet)
 {
-	auto vertices = mDisplay.Vertices();
-	
-	mVertexCount = vertices.size() * 3;
+	DendroTrace::Span span("DendroGrid::FromDense (new)");
+	WriteLock lock(this);
+
+	if (!buffer || step < 1 || voxelSize <= 0.0) {
+		return false;
+	}
+
+	openvdb::FloatGrid::Ptr grid;
+	if (levelSet) {
+		grid = openvdb::createLevelSet<openvdb::FloatGrid>(voxelSize, std::max(bandwidth, 1.0));
+	}
+	else {
+		grid = openvdb::FloatGrid::create(0.0f);
+		grid->setTransform(openvdb::math::Transform::createLinearTransform(voxelSize));
+		grid->setGridClass(openvdb::GRID_FOG_VOLUME);
+	}
+
+	const openvdb::CoordBBox bbox = DenseRegion(*grid, bMin, bMax, world);
+	if (bbox.empty()) {
+		return false;
+	}
+
+	// the caller's array has to cover the box, there is no existing grid to size it against
+	const int64_t extent = DendroDense(bbox, step, strides).Extent();
+	if (extent < 0 || extent > size) {
+		return false;
+	}
+
+	// the grid is replaced outright, so one shared with the cache is let go rather than copied
+	mGrid = grid;
+	mHash.store(0);
+	mDisplay.Clear();
+	mDisplayRead.store(0);
+
+	WriteDense(bbox, step, buffer, strides, threshold);
+
+	return true;
+}
+
+void DendroGrid::WriteDense(const openvdb::CoordBBox& bbox, int step, const float * buffer, const int64_t * strides, double threshold)
+{
+	const bool levelSet = mGrid->getGridClass() == openvdb::GRID_LEVEL_SET;
+
+	// a non-positive threshold keeps the whole band of a level set and any density of a fog volume
+	if (threshold <= 0.0) {
+		threshold = levelSet ? mGrid->background() : 0.0;
+	}
 
-	float *verticeArray = reinterpret_cast<float*>(malloc(mVertexCount * sizeof(float)));
+	DendroDense dense(bbox, step, strides);
+	dense.Write(*mGrid, buffer, static_cast<float>(threshold));
 
-	int i = 0;
-	for (auto it = vertices.begin(); it != vertices.end(); ++it) {
-		verticeArray[i] = it->x();
-		verticeArray[i + 1] = it->y();
-		verticeArray[i + 2] = it->z();
-		i += 3;
+	if (levelSet) {
+		// simulation output carries no sign outside the band, so fix the inside before rebuilding it.
+		// the band keeps its width, so it is renormalized here rather than by the resize in CompactGrid
+		DendroTrace::Span phase("rebuild band");
+		openvdb::tools::signedFloodFill(mGrid->tree());
+
+		openvdb::tools::LevelSetTracker<openvdb::FloatGrid> tracker(*mGrid);
+		tracker.track();
 	}
 
-	return verticeArray;
+	CompactGrid(0.0);
 }
 
-int * DendroGrid::GetMeshFaces()
+DendroMesh DendroGrid::BuildMesh(double isovalue, double adaptivity, int targetFaces, double maxError) const
 {
-	auto faces = mDisplay.Faces();
+	isovalue /= mGrid->voxelSize().x();
+
+	std::vector<openvdb::Vec3s> points;
+	std::vector<openvdb::Vec4I> quads;
+	std::vector<openvdb::Vec3I> triangles;
 
-	mFaceCount = faces.size() * 4;
+	{
+		DendroTrace::Span phase("volumeToMesh");
+		openvdb::tools::volumeToMesh<openvdb::FloatGrid>(*mGrid, points, triangles, quads, isovalue, adaptivity);
+	}
 
-	int *faceArray = reinterpret_cast<int*>(malloc(mFaceCount * sizeof(int)));
+	DendroMesh mesh;
 
-	int i = 0;
-	for (auto it = faces.begin(); it != faces.end(); ++it) {
-		faceArray[i] = it->w();
-		faceArray[i + 1] = it->x();
-		faceArray[i + 2] = it->y();
-		faceArray[i + 3] = it->z();
-		i += 4;
+	{
+		DendroTrace::Span copy("copy polygons");
+
+		mesh.AddVertice(points);
+
+		auto begin = triangles.begin();
+		auto end = triangles.end();
+
+		for (auto it = begin; it != end; ++it) {
+			int w = -1;
+			int x = it->x();
+			int y = it->y();
+			int z = it->z();
+
+			openvdb::Vec4I face(x,y,z,w);
+
+			mesh.AddFace(face);
+		}
+
+		mesh.AddFace(quads);
 	}
 
-	return faceArray;
+	FinalizeMesh(mesh, isovalue, targetFaces, maxError);
+
+	return mesh;
+}
+
+void DendroGrid::FinalizeMesh(DendroMesh& mesh, double isovalue, int targetFaces, double maxError) const
+{
+	DendroTrace::Span span("finalize mesh");
+
+	// weld seams and drop degenerate faces before sampling so no work is spent on culled vertices
+	mesh.Weld();
+
+	// optional quadric decimation, skipped when neither a face count nor an error bound is given
+	mesh.Decimate(*mGrid, isovalue, targetFaces, maxError);
+
+	// per-vertex normals come from the level set gradient and drive the face winding
+	mesh.ComputeNormals(*mGrid);
+	mesh.Orient();
 }
 
-int DendroGrid::GetVertexCount()
+float * DendroGrid::GetMeshVertices(int& size) const
 {
-	return mVertexCount;
+	DendroTrace::Span span("DendroGrid::GetMeshVertices");
+	ReadLock lock(mMutex);
+
+	mDisplayRead.fetch_or(1);
+	return mDisplay.VertexBuffer(size);
 }
 
-int DendroGrid::GetFaceCount()
+int * DendroGrid::GetMeshFaces(int& size) const
 {
-	return mFaceCount;
+	DendroTrace::Span span("DendroGrid::GetMeshFaces");
+	ReadLock lock(mMutex);
+
+	mDisplayRead.fetch_or(2);
+	return mDisplay.FaceBuffer(size);
+}
+
+float * DendroGrid::GetMeshNormals(int& size) const
+{
+	DendroTrace::Span span("DendroGrid::GetMeshNormals");
+	ReadLock lock(mMutex);
+
+	mDisplayRead.fetch_or(4);
+	return mDisplay.NormalBuffer(size);
 }
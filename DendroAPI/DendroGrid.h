@@ -5,60 +5,156 @@
 
 #include "DendroParticle.h"
 #include "DendroMesh.h"
+#include "DendroMemory.h"
+#include "DendroCache.h"
 
 #define IMATH_HALF_NO_LOOKUP_TABLE
 
 #include <openvdb/openvdb.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
 #include <vector>
 #include <string>
 
+// every grid has a reader writer lock. const methods are queries that share it and keep no state
+// between calls, so any number of threads can sample, mesh into their own buffers, or find closest
+// points on one grid at once. everything else edits the grid or its display mesh and holds the lock
+// exclusively, along with shared locks on any operand grids
 class DendroGrid
 {
 public:
+	// smooth minimum used to blend csg seams
+	enum SmoothMin {
+		POLYNOMIAL = 0,
+		EXPONENTIAL = 1
+	};
+
 	DendroGrid();
 	DendroGrid(DendroGrid * grid);
 	~DendroGrid();
 
-	openvdb::FloatGrid::Ptr Grid();
+	// the current grid. later edits copy it first, so the pointer stays a stable snapshot
+	openvdb::FloatGrid::Ptr Grid() const;
 
 	bool Read(const char *vFile);
-	bool Write(const char *vFile);
+	bool Write(const char *vFile) const;
 
 	bool CreateFromMesh(DendroMesh vMesh, double voxelSize, double bandwidth);
-	bool CreateFromPoints(DendroParticle vPoints, double voxelSize, double bandwidth);
+	bool CreateFromPoints(const DendroParticle& vPoints, double voxelSize, double bandwidth);
+
+	bool CreateSphere(openvdb::math::Mat4d xform, double radius, double voxelSize, double bandwidth);
+	bool CreateBox(openvdb::math::Mat4d xform, double x, double y, double z, double voxelSize, double bandwidth);
+	bool CreateCylinder(openvdb::math::Mat4d xform, double radius, double height, double voxelSize, double bandwidth);
+	bool CreateTorus(openvdb::math::Mat4d xform, double majorRadius, double minorRadius, double voxelSize, double bandwidth);
+	bool CreateCapsule(openvdb::math::Mat4d xform, double radius, double height, double voxelSize, double bandwidth);
 
 	void Transform(openvdb::math::Mat4d xform);
 
-	void BooleanUnion(DendroGrid vAdd);
-	void BooleanIntersection(DendroGrid vIntersect);
-	void BooleanDifference(DendroGrid vSubtract);
+	void BooleanUnion(DendroGrid& vAdd);
+	void BooleanIntersection(DendroGrid& vIntersect);
+	void BooleanDifference(DendroGrid& vSubtract);
+
+	// csg with the seam blended over radius world units. only voxels where both bands overlap are
+	// revisited, the radius is capped at the narrower band
+	void BooleanUnion(DendroGrid& vAdd, double radius, int kernel);
+	void BooleanIntersection(DendroGrid& vIntersect, double radius, int kernel);
+	void BooleanDifference(DendroGrid& vSubtract, double radius, int kernel);
 
 	void Offset(double amount);
-	void Offset(double amount, DendroGrid vMask, double min, double max, bool invert);
+	void Offset(double amount, DendroGrid& vMask, double min, double max, bool invert);
 
 	void Smooth(int type, int iterations, int width);
-	void Smooth(int type, int iterations, int width, DendroGrid vMask, double min, double max, bool invert);
+	void Smooth(int type, int iterations, int width, DendroGrid& vMask, double min, double max, bool invert);
+
+	void Blend(DendroGrid& bGrid, double bPosition, double bEnd);
+	void Blend(DendroGrid& bGrid, double bPosition, double bEnd, DendroGrid& vMask, double min, double max, bool invert);
+
+	uint64_t Hash() const;
+
+	void Compact(double halfWidth);
+	size_t MemoryUsage() const;
 
-	void Blend(DendroGrid bGrid, double bPosition, double bEnd);
-	void Blend(DendroGrid bGrid, double bPosition, double bEnd, DendroGrid vMask, double min, double max, bool invert);
+	void ClosestPoint(std::vector<openvdb::Vec3R>& points, std::vector<float>& distances) const;
+	void Slice(openvdb::Vec3d origin, openvdb::Vec3d normal, double spacing, int count, double isovalue, std::vector<float>& vertices, std::vector<int>& contours) const;
 
-	void ClosestPoint(std::vector<openvdb::Vec3R>& points, std::vector<float>& distances);
+	// a new mesh of the grid, the display mesh is left alone
+	DendroMesh Mesh(double isovalue, double adaptivity, int targetFaces, double maxError) const;
 
-	DendroMesh Display();
+	// streams a mesh of the grid to a file region by region, see DendroExport for formats
+	bool Export(const char * path, int format, double isovalue, double adaptivity) const;
+
+	// copies a world or index space box to and from a strided float array, see DendroDense. dims gets
+	// the samples per axis and a null buffer only reports them
+	bool ToDense(openvdb::Vec3d bMin, openvdb::Vec3d bMax, bool world, int step, float * buffer, const int64_t * strides, int * dims) const;
+	bool FromDense(openvdb::Vec3d bMin, openvdb::Vec3d bMax, bool world, int step, const float * buffer, const int64_t * strides, double threshold);
+
+	// replaces the grid with a new level set or fog volume of the given voxel size built from the array,
+	// so solver output can be brought into a fresh handle. size is the buffer length in floats
+	bool FromDense(openvdb::Vec3d bMin, openvdb::Vec3d bMax, bool world, int step, const float * buffer, int64_t size, const int64_t * strides, double threshold, double voxelSize, double bandwidth, bool levelSet);
+
+	DendroMesh Display() const;
 
 	void UpdateDisplay();
 	void UpdateDisplay(double isovalue, double adaptivity);
+	void UpdateDisplay(double isovalue, double adaptivity, int targetFaces, double maxError);
 
-	float * GetMeshVertices();
-	int * GetMeshFaces();
-	int GetVertexCount();
-	int GetFaceCount();
+	float * GetMeshVertices(int& size) const;
+	int * GetMeshFaces(int& size) const;
+	float * GetMeshNormals(int& size) const;
 
 private:
+	friend class DendroMemory;
+
+	using ReadLock = std::shared_lock<std::shared_mutex>;
+
+	// exclusive lock on a grid and shared locks on its operands for the lifetime of the guard. locks
+	// are taken in address order so grids used as each other's operands cannot deadlock, and every
+	// grid involved is marked in use so the memory budget leaves it alone
+	class WriteLock
+	{
+	public:
+		WriteLock(DendroGrid * grid, std::vector<DendroGrid*> operands = {});
+		~WriteLock();
+
+	private:
+		WriteLock(const WriteLock&) = delete;
+		WriteLock& operator=(const WriteLock&) = delete;
+
+		std::vector<std::pair<DendroGrid*, bool>> mLocked;
+		std::unique_ptr<DendroMemory::Use> mUse;
+	};
+
+	uint64_t ContentHash() const;
+	size_t Measure() const;
+
+	DendroCache::Key CacheKey(int operation, std::vector<DendroGrid*> operands, std::vector<double> parameters);
+	bool FromCache(const DendroCache::Key& key);
+	void ToCache(const DendroCache::Key& key);
+	void BeginEdit();
+	void Composite(DendroGrid& operand, int operation, double radius, int kernel);
+
+	template<typename DistanceT>
+	bool CreateFromDistance(const DistanceT& distance, openvdb::Vec3d bMin, openvdb::Vec3d bMax, openvdb::math::Mat4d xform, double voxelSize, double bandwidth);
+
+	void ReleaseCaches();
+	void CompactGrid(double halfWidth);
+	void WriteDense(const openvdb::CoordBBox& bbox, int step, const float * buffer, const int64_t * strides, double threshold);
+
+	// true once every buffer of the display mesh was read back, so dropping it loses nothing
+	bool DisplayRead() const;
+
+	DendroMesh BuildMesh(double isovalue, double adaptivity, int targetFaces, double maxError) const;
+	void FinalizeMesh(DendroMesh& mesh, double isovalue, int targetFaces, double maxError) const;
+
 	openvdb::FloatGrid::Ptr mGrid;
 	DendroMesh mDisplay;
-	int mFaceCount;
-	int mVertexCount;
+	mutable std::atomic<uint64_t> mHash;
+	mutable std::shared_mutex mMutex;
+
+	// display buffers handed out since the mesh was built, one bit each for vertices, faces and normals
+	mutable std::atomic<int> mDisplayRead;
 };
 
 #endif // __DENDROGRID_H__
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "stdafx.h"
+#include "DendroMemory.h"
+#include "DendroCache.h"
+#include "DendroGrid.h"
+#include "DendroTrace.h"
+
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+DendroMemory::Use::Use(std::vector<DendroGrid*> grids, DendroGrid * edited) : mGrids(grids), mEdited(edited)
+{
+	DendroMemory::Instance().Acquire(mGrids);
+}
+
+DendroMemory::Use::~Use()
+{
+	// measured before taking the lock while the caller still holds the grids, so they cannot change
+	// or be evicted in between
+	std::vector<size_t> bytes;
+	for (auto it = mGrids.begin(); it != mGrids.end(); ++it) {
+		bytes.push_back((*it)->Measure());
+	}
+
+	DendroMemory::Instance().Release(mGrids, bytes, mEdited);
+}
+
+DendroMemory& DendroMemory::Instance()
+{
+	static DendroMemory instance;
+	return instance;
+}
+
+DendroMemory::DendroMemory() : mBudget(0), mUsage(0), mClock(0)
+{
+}
+
+void DendroMemory::Register(DendroGrid * grid)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	Entry entry;
+	entry.bytes = 0;
+	entry.lastUse = ++mClock;
+	entry.busy = 0;
+	entry.compact = false;
+
+	mGrids[grid] = entry;
+}
+
+void DendroMemory::Unregister(DendroGrid * grid)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mGrids.find(grid);
+	if (it == mGrids.end()) {
+		return;
+	}
+
+	mUsage -= it->second.bytes;
+	mGrids.erase(it);
+}
+
+void DendroMemory::SetBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mBudget = bytes;
+	Enforce({});
+}
+
+size_t DendroMemory::Budget()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBudget;
+}
+
+size_t DendroMemory::Usage()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mUsage + DendroCache::Instance().Bytes();
+}
+
+void DendroMemory::Acquire(const std::vector<DendroGrid*>& grids)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (auto grid = grids.begin(); grid != grids.end(); ++grid) {
+		auto it = mGrids.find(*grid);
+		if (it != mGrids.end()) {
+			it->second.busy++;
+			it->second.lastUse = ++mClock;
+		}
+	}
+}
+
+void DendroMemory::Release(const std::vector<DendroGrid*>& grids, const std::vector<size_t>& bytes, DendroGrid * edited)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (size_t n = 0; n < grids.size(); n++) {
+		auto it = mGrids.find(grids[n]);
+		if (it == mGrids.end()) {
+			continue;
+		}
+
+		it->second.busy--;
+		if (grids[n] == edited) {
+			it->second.compact = false;
+		}
+
+		mUsage = mUsage - it->second.bytes + bytes[n];
+		it->second.bytes = bytes[n];
+	}
+
+	// the caller still holds every one of these grids locked, so none of them may be touched here
+	Enforce(grids);
+}
+
+void DendroMemory::Enforce(const std::vector<DendroGrid*>& keep)
+{
+	// a budget of zero is unlimited
+	if (mBudget == 0) {
+		return;
+	}
+
+	// start evicting once live grids and cached results reach 90% of the budget
+	DendroCache& cache = DendroCache::Instance();
+	size_t cached = cache.Bytes();
+	if ((mUsage + cached) * 10 < mBudget * 9) {
+		return;
+	}
+
+	DendroTrace::Span span("DendroMemory::Enforce");
+
+	// cached results are only a shortcut, so they are dropped before any grid is touched
+	cached -= cache.Trim(mUsage + cached - mBudget / 10 * 9 + 1);
+	if ((mUsage + cached) * 10 < mBudget * 9) {
+		return;
+	}
+
+	std::vector<std::pair<uint64_t, DendroGrid*>> candidates;
+	for (auto it = mGrids.begin(); it != mGrids.end(); ++it) {
+		if (it->second.busy == 0 && std::find(keep.begin(), keep.end(), it->first) == keep.end()) {
+			candidates.push_back(std::make_pair(it->second.lastUse, it->first));
+		}
+	}
+
+	// least recently used first
+	std::sort(candidates.begin(), candidates.end());
+
+	// display meshes the caller has read back go first, nothing reads them again. one that was just
+	// built and not yet read is kept. only if that is not enough are the grids compacted, each one
+	// once until it is edited again
+	for (int pass = 0; pass < 2 && (mUsage + cached) * 10 >= mBudget * 9; pass++) {
+		for (auto it = candidates.begin(); it != candidates.end() && (mUsage + cached) * 10 >= mBudget * 9; ++it) {
+			DendroGrid *grid = it->second;
+			Entry &entry = mGrids[grid];
+
+			if (pass == 1 && entry.compact) {
+				continue;
+			}
+
+			// grids being read or edited on another thread are skipped rather than waited on
+			std::unique_lock<std::shared_mutex> lock(grid->mMutex, std::try_to_lock);
+			if (!lock.owns_lock()) {
+				continue;
+			}
+
+			if (pass == 0) {
+				if (!grid->DisplayRead()) {
+					continue;
+				}
+				grid->ReleaseCaches();
+			}
+			else {
+				grid->CompactGrid(0.0);
+				entry.compact = true;
+			}
+
+			const size_t bytes = grid->Measure();
+			mUsage = mUsage - entry.bytes + bytes;
+			entry.bytes = bytes;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef __DENDROMEMORY_H__
+#define __DENDROMEMORY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class DendroGrid;
+
+class DendroMemory
+{
+public:
+	// marks grids as in use for the lifetime of the guard. on release the grids are
+	// re-measured and the budget enforced once against every grid that is not in use.
+	// the edited grid, if any, may be compacted again afterwards
+	class Use
+	{
+	public:
+		Use(std::vector<DendroGrid*> grids, DendroGrid * edited);
+		~Use();
+
+	private:
+		Use(const Use&) = delete;
+		Use& operator=(const Use&) = delete;
+
+		std::vector<DendroGrid*> mGrids;
+		DendroGrid * mEdited;
+	};
+
+	static DendroMemory& Instance();
+
+	void Register(DendroGrid * grid);
+	void Unregister(DendroGrid * grid);
+
+	void SetBudget(size_t bytes);
+	size_t Budget();
+	size_t Usage();
+
+private:
+	struct Entry {
+		size_t bytes;
+		uint64_t lastUse;
+		int busy;
+
+		// compacted by the budget and not edited since, so compacting again frees nothing
+		bool compact;
+	};
+
+	DendroMemory();
+
+	void Acquire(const std::vector<DendroGrid*>& grids);
+	void Release(const std::vector<DendroGrid*>& grids, const std::vector<size_t>& bytes, DendroGrid * edited);
+	void Enforce(const std::vector<DendroGrid*>& keep);
+
+	std::mutex mMutex;
+	std::unordered_map<DendroGrid*, Entry> mGrids;
+	size_t mBudget;
+	size_t mUsage;
+	uint64_t mClock;
+};
+
+#endif // __DENDROMEMORY_H__
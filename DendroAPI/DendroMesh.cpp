@@ -1,18 +1,147 @@
 #include "stdafx.h"
 #include "DendroMesh.h"
+#include "DendroTrace.h"
 
+#include <openvdb/tools/Interpolation.h>
+#include <openvdb/util/Util.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace {
+
+	// number of corners used by a face, triangles store INVALID_IDX in their last slot
+	inline int FaceCorners(const openvdb::Vec4I& f)
+	{
+		return (f[3] == openvdb::util::INVALID_IDX) ? 3 : 4;
+	}
+
+	// newell normal of a face, length is twice the face area
+	inline openvdb::Vec3d FaceNormal(const std::vector<openvdb::Vec3s>& vertices, const openvdb::Vec4I& f)
+	{
+		openvdb::Vec3d normal(0.0);
+
+		const int corners = FaceCorners(f);
+		for (int i = 0; i < corners; i++) {
+			const openvdb::Vec3d a(vertices[f[i]]);
+			const openvdb::Vec3d b(vertices[f[(i + 1) % corners]]);
+			normal += a.cross(b);
+		}
+
+		return normal;
+	}
+
+	// collapse repeated corners of a remapped face, returns false if the face is degenerate
+	inline bool CollapseFace(openvdb::Vec4I& f)
+	{
+		openvdb::Index32 corners[4];
+		int count = 0;
+
+		const int fCount = FaceCorners(f);
+		for (int i = 0; i < fCount; i++) {
+			if (count == 0 || corners[count - 1] != f[i]) {
+				corners[count++] = f[i];
+			}
+		}
+
+		// wrap around so the last corner is compared against the first
+		if (count > 1 && corners[count - 1] == corners[0]) {
+			count--;
+		}
+
+		if (count < 3) {
+			return false;
+		}
+
+		// a non-adjacent repeat leaves a bowtie with no area
+		if (count == 4 && (corners[0] == corners[2] || corners[1] == corners[3])) {
+			return false;
+		}
+
+		f = openvdb::Vec4I(corners[0], corners[1], corners[2], (count == 4) ? corners[3] : openvdb::util::INVALID_IDX);
+
+		return true;
+	}
+
+	// symmetric 4x4 error quadric stored as its upper triangle, with the summed weight of its planes
+	struct Quadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		double weight;
+
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), weight(0) {}
+
+		// plane quadric for unit normal n and offset d, weighted by w
+		Quadric(const openvdb::Vec3d& n, double d, double w)
+			: a2(w * n.x() * n.x()), ab(w * n.x() * n.y()), ac(w * n.x() * n.z()), ad(w * n.x() * d),
+			b2(w * n.y() * n.y()), bc(w * n.y() * n.z()), bd(w * n.y() * d),
+			c2(w * n.z() * n.z()), cd(w * n.z() * d), d2(w * d * d), weight(w) {}
+
+		Quadric& operator+=(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd; d2 += q.d2;
+			weight += q.weight;
+			return *this;
+		}
+
+		double Error(const openvdb::Vec3d& p) const
+		{
+			const double x = p.x(), y = p.y(), z = p.z();
+			return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z + d2;
+		}
+
+		// position minimizing the error, false if the system is close to singular
+		bool Optimum(openvdb::Vec3d& p) const
+		{
+			const openvdb::Mat3d A(a2, ab, ac, ab, b2, bc, ac, bc, c2);
+			const double scale = (a2 + b2 + c2) / 3.0;
+			const double det = A.det();
+
+			if (std::abs(det) <= 1e-6 * scale * scale * scale) {
+				return false;
+			}
+
+			p = A.inverse() * openvdb::Vec3d(-ad, -bd, -cd);
+			return true;
+		}
+	};
+
+	// candidate edge collapse, stamps detect entries made stale by later collapses
+	struct Collapse {
+		double cost;
+		openvdb::Index32 u, v;
+		openvdb::Index32 uStamp, vStamp;
+		openvdb::Vec3d position;
+
+		bool operator>(const Collapse& c) const { return cost > c.cost; }
+	};
+}
 
 DendroMesh::DendroMesh()
 {
 	mVertices.clear();
 	mFaces.clear();
+	mNormals.clear();
 }
 
-DendroMesh DendroMesh::Duplicate()
+DendroMesh DendroMesh::Duplicate() const
 {
 	DendroMesh mesh;
 	mesh.AddVertice(mVertices);
 	mesh.AddFace(mFaces);
+	mesh.mNormals = mNormals;
 
 	return mesh;
 }
@@ -21,7 +150,7 @@ DendroMesh::~DendroMesh()
 {
 }
 
-bool DendroMesh::IsValid()
+bool DendroMesh::IsValid() const
 {
 	if (mFaces.size() > 0 && mVertices.size() > 0) {
 		return true;
@@ -30,16 +159,73 @@ bool DendroMesh::IsValid()
 	return false;
 }
 
-std::vector<openvdb::Vec3s> DendroMesh::Vertices()
+std::vector<openvdb::Vec3s> DendroMesh::Vertices() const
 {
 	return mVertices;
 }
 
-std::vector<openvdb::Vec4I> DendroMesh::Faces()
+std::vector<openvdb::Vec4I> DendroMesh::Faces() const
 {
 	return mFaces;
 }
 
+std::vector<openvdb::Vec3s> DendroMesh::Normals() const
+{
+	return mNormals;
+}
+
+float * DendroMesh::VertexBuffer(int& size) const
+{
+	size = static_cast<int>(mVertices.size() * 3);
+
+	float *verticeArray = reinterpret_cast<float*>(malloc(size * sizeof(float)));
+
+	int i = 0;
+	for (auto it = mVertices.begin(); it != mVertices.end(); ++it) {
+		verticeArray[i] = it->x();
+		verticeArray[i + 1] = it->y();
+		verticeArray[i + 2] = it->z();
+		i += 3;
+	}
+
+	return verticeArray;
+}
+
+int * DendroMesh::FaceBuffer(int& size) const
+{
+	size = static_cast<int>(mFaces.size() * 4);
+
+	int *faceArray = reinterpret_cast<int*>(malloc(size * sizeof(int)));
+
+	int i = 0;
+	for (auto it = mFaces.begin(); it != mFaces.end(); ++it) {
+		faceArray[i] = it->w();
+		faceArray[i + 1] = it->x();
+		faceArray[i + 2] = it->y();
+		faceArray[i + 3] = it->z();
+		i += 4;
+	}
+
+	return faceArray;
+}
+
+float * DendroMesh::NormalBuffer(int& size) const
+{
+	size = static_cast<int>(mNormals.size() * 3);
+
+	float *normalArray = reinterpret_cast<float*>(malloc(size * sizeof(float)));
+
+	int i = 0;
+	for (auto it = mNormals.begin(); it != mNormals.end(); ++it) {
+		normalArray[i] = it->x();
+		normalArray[i + 1] = it->y();
+		normalArray[i + 2] = it->z();
+		i += 3;
+	}
+
+	return normalArray;
+}
+
 void DendroMesh::AddVertice(openvdb::Vec3s v)
 {
 	mVertices.push_back(v);
@@ -60,9 +246,539 @@ void DendroMesh::AddFace(std::vector<openvdb::Vec4I> f)
 	mFaces.insert(mFaces.end(), f.begin(), f.end());
 }
 
+void DendroMesh::Weld()
+{
+	DendroTrace::Span span("DendroMesh::Weld");
+
+	using openvdb::Index32;
+
+	const size_t vCount = mVertices.size();
+	if (vCount == 0) {
+		return;
+	}
+
+	// sort vertex indices by position so coincident vertices end up next to each other
+	std::vector<Index32> order(vCount);
+	for (size_t n = 0; n < vCount; n++) {
+		order[n] = static_cast<Index32>(n);
+	}
+
+	tbb::parallel_sort(order.begin(), order.end(), [this](Index32 a, Index32 b) {
+		const openvdb::Vec3s &pa = mVertices[a], &pb = mVertices[b];
+		if (pa.x() != pb.x()) return pa.x() < pb.x();
+		if (pa.y() != pb.y()) return pa.y() < pb.y();
+		if (pa.z() != pb.z()) return pa.z() < pb.z();
+		return a < b;
+	});
+
+	// point every vertex at the first vertex sharing its position
+	std::vector<Index32> remap(vCount);
+	Index32 first = order[0];
+	remap[first] = first;
+	for (size_t n = 1; n < vCount; n++) {
+		const Index32 idx = order[n];
+		if (mVertices[idx] != mVertices[first]) {
+			first = idx;
+		}
+		remap[idx] = first;
+	}
+
+	// remap faces and flag the ones that collapsed or have no area
+	std::vector<char> keep(mFaces.size(), 0);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, mFaces.size()), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			openvdb::Vec4I& f = mFaces[n];
+			const int corners = FaceCorners(f);
+			for (int i = 0; i < corners; i++) {
+				f[i] = remap[f[i]];
+			}
+
+			keep[n] = (CollapseFace(f) && !openvdb::math::isZero(FaceNormal(mVertices, f).lengthSqr())) ? 1 : 0;
+		}
+	});
+
+	size_t fCount = 0;
+	for (size_t n = 0; n < mFaces.size(); n++) {
+		if (keep[n]) {
+			mFaces[fCount++] = mFaces[n];
+		}
+	}
+	mFaces.resize(fCount);
+
+	// cull vertices no longer referenced by any face
+	std::vector<Index32> used(vCount, 0);
+	for (auto it = mFaces.begin(); it != mFaces.end(); ++it) {
+		const int corners = FaceCorners(*it);
+		for (int i = 0; i < corners; i++) {
+			used[(*it)[i]] = 1;
+		}
+	}
+
+	const bool hasNormals = (mNormals.size() == vCount);
+
+	Index32 next = 0;
+	for (size_t n = 0; n < vCount; n++) {
+		if (used[n]) {
+			mVertices[next] = mVertices[n];
+			if (hasNormals) {
+				mNormals[next] = mNormals[n];
+			}
+			used[n] = next++;
+		}
+	}
+	mVertices.resize(next);
+	mNormals.resize(hasNormals ? next : 0);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, mFaces.size()), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			openvdb::Vec4I& f = mFaces[n];
+			const int corners = FaceCorners(f);
+			for (int i = 0; i < corners; i++) {
+				f[i] = used[f[i]];
+			}
+		}
+	});
+}
+
+void DendroMesh::ComputeNormals(const openvdb::FloatGrid& grid)
+{
+	DendroTrace::Span span("DendroMesh::ComputeNormals");
+
+	using SamplerT = openvdb::tools::GridSampler<openvdb::FloatGrid::ConstAccessor, openvdb::tools::BoxSampler>;
+
+	mNormals.resize(mVertices.size());
+
+	// central difference step of half a voxel in world space
+	const openvdb::Vec3d voxelSize = grid.voxelSize();
+	const double h = 0.5 * std::min(voxelSize.x(), std::min(voxelSize.y(), voxelSize.z()));
+
+	// level sets increase outward, fog volumes increase inward
+	const double sign = (grid.getGridClass() == openvdb::GRID_LEVEL_SET) ? 1.0 : -1.0;
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, mVertices.size()), [&](const tbb::blocked_range<size_t>& r) {
+		// every task samples through its own accessor so no cache is shared between threads
+		openvdb::FloatGrid::ConstAccessor acc = grid.getConstAccessor();
+		SamplerT sampler(acc, grid.transform());
+
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			const openvdb::Vec3d p(mVertices[n]);
+
+			openvdb::Vec3d gradient(
+				sampler.wsSample(p + openvdb::Vec3d(h, 0, 0)) - sampler.wsSample(p - openvdb::Vec3d(h, 0, 0)),
+				sampler.wsSample(p + openvdb::Vec3d(0, h, 0)) - sampler.wsSample(p - openvdb::Vec3d(0, h, 0)),
+				sampler.wsSample(p + openvdb::Vec3d(0, 0, h)) - sampler.wsSample(p - openvdb::Vec3d(0, 0, h)));
+
+			const double length = gradient.length();
+			mNormals[n] = (length > 0.0) ? openvdb::Vec3s(gradient * (sign / length)) : openvdb::Vec3s(0.0f);
+		}
+	});
+
+	// vertices sitting on a flat spot of the field fall back to their face normals
+	bool flat = false;
+	for (auto it = mNormals.begin(); it != mNormals.end() && !flat; ++it) {
+		flat = it->isZero();
+	}
+
+	if (flat) {
+		std::vector<openvdb::Vec3d> accumulated(mVertices.size(), openvdb::Vec3d(0.0));
+		for (auto it = mFaces.begin(); it != mFaces.end(); ++it) {
+			const openvdb::Vec3d normal = FaceNormal(mVertices, *it);
+			const int corners = FaceCorners(*it);
+			for (int i = 0; i < corners; i++) {
+				accumulated[(*it)[i]] += normal;
+			}
+		}
+
+		for (size_t n = 0; n < mNormals.size(); n++) {
+			if (mNormals[n].isZero() && accumulated[n].length() > 0.0) {
+				mNormals[n] = openvdb::Vec3s(accumulated[n].unit());
+			}
+		}
+	}
+}
+
+void DendroMesh::Orient()
+{
+	DendroTrace::Span span("DendroMesh::Orient");
+
+	if (mNormals.size() != mVertices.size()) {
+		return;
+	}
+
+	// flip any face whose winding disagrees with the normals at its corners
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, mFaces.size()), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			openvdb::Vec4I& f = mFaces[n];
+
+			openvdb::Vec3d expected(0.0);
+			const int corners = FaceCorners(f);
+			for (int i = 0; i < corners; i++) {
+				expected += openvdb::Vec3d(mNormals[f[i]]);
+			}
+
+			if (FaceNormal(mVertices, f).dot(expected) < 0.0) {
+				if (corners == 3) {
+					std::swap(f[1], f[2]);
+				}
+				else {
+					std::swap(f[1], f[3]);
+				}
+			}
+		}
+	});
+}
+
+void DendroMesh::Decimate(const openvdb::FloatGrid& grid, double isovalue, int targetFaces, double maxError)
+{
+	DendroTrace::Span span("DendroMesh::Decimate");
+
+	using openvdb::Index32;
+	using SamplerT = openvdb::tools::GridSampler<openvdb::FloatGrid::ConstAccessor, openvdb::tools::BoxSampler>;
+
+	if ((targetFaces <= 0 && maxError <= 0.0) || mVertices.empty() || mFaces.empty()) {
+		return;
+	}
+
+	// collapses work on triangles, so quads are split along their shorter diagonal
+	std::vector<openvdb::Vec3I> triangles;
+	triangles.reserve(mFaces.size() * 2);
+	for (auto it = mFaces.begin(); it != mFaces.end(); ++it) {
+		const openvdb::Vec4I& f = *it;
+		if (FaceCorners(f) == 3) {
+			triangles.push_back(openvdb::Vec3I(f[0], f[1], f[2]));
+		}
+		else if ((mVertices[f[0]] - mVertices[f[2]]).lengthSqr() <= (mVertices[f[1]] - mVertices[f[3]]).lengthSqr()) {
+			triangles.push_back(openvdb::Vec3I(f[0], f[1], f[2]));
+			triangles.push_back(openvdb::Vec3I(f[0], f[2], f[3]));
+		}
+		else {
+			triangles.push_back(openvdb::Vec3I(f[0], f[1], f[3]));
+			triangles.push_back(openvdb::Vec3I(f[1], f[2], f[3]));
+		}
+	}
+
+	const size_t vCount = mVertices.size();
+	const size_t tCount = triangles.size();
+
+	std::vector<openvdb::Vec3d> positions(vCount);
+	for (size_t n = 0; n < vCount; n++) {
+		positions[n] = openvdb::Vec3d(mVertices[n]);
+	}
+
+	std::vector<std::vector<Index32>> vertexFaces(vCount);
+	for (size_t n = 0; n < tCount; n++) {
+		for (int i = 0; i < 3; i++) {
+			vertexFaces[triangles[n][i]].push_back(static_cast<Index32>(n));
+		}
+	}
+
+	// area weighted plane quadrics, summed per vertex from its own faces so no writes are shared
+	std::vector<Quadric> faceQuadrics(tCount);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, tCount), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			const openvdb::Vec3I& t = triangles[n];
+			const openvdb::Vec3d normal = (positions[t[1]] - positions[t[0]]).cross(positions[t[2]] - positions[t[0]]);
+			const double length = normal.length();
+			if (length > 0.0) {
+				const openvdb::Vec3d unit = normal / length;
+				faceQuadrics[n] = Quadric(unit, -unit.dot(positions[t[0]]), 0.5 * length);
+			}
+		}
+	});
+
+	std::vector<Quadric> quadrics(vCount);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, vCount), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t n = r.begin(); n < r.end(); n++) {
+			for (auto it = vertexFaces[n].begin(); it != vertexFaces[n].end(); ++it) {
+				quadrics[n] += faceQuadrics[*it];
+			}
+		}
+	});
+	faceQuadrics.clear();
+
+	std::vector<char> deadFace(tCount, 0);
+	std::vector<char> deadVertex(vCount, 0);
+	std::vector<Index32> stamps(vCount, 0);
+	std::atomic<size_t> liveFaces(tCount);
+
+	const double voxelSize = grid.voxelSize()[0];
+	const double maxCost = (maxError > 0.0) ? maxError * maxError : std::numeric_limits<double>::max();
+
+	// collapsed vertices have to stay on the level set, which keeps creases from being rounded off
+	const double surfaceTolerance = (maxError > 0.0) ? maxError : voxelSize;
+
+	// vertices are partitioned into cells that are decimated independently. only edges whose whole
+	// one-ring lies inside a cell are collapsed, so no two threads ever touch the same face
+	const double cellWidth = 32.0 * voxelSize;
+
+	std::vector<openvdb::Coord> cells(vCount);
+	std::vector<char> freeVertex(vCount, 0);
+	std::vector<Index32> order;
+
+	const int rounds = 8;
+	for (int round = 0; round < rounds; round++) {
+		const size_t remaining = liveFaces.load();
+		if (targetFaces > 0 && remaining <= static_cast<size_t>(targetFaces)) {
+			break;
+		}
+
+		// shift the partition every other round so previous cell borders get decimated too
+		const double shift = (round % 2) ? 0.5 * cellWidth : 0.0;
+
+		order.clear();
+		for (size_t n = 0; n < vCount; n++) {
+			if (!deadVertex[n]) {
+				order.push_back(static_cast<Index32>(n));
+			}
+		}
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, order.size()), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				const openvdb::Vec3d& p = positions[order[n]];
+				cells[order[n]] = openvdb::Coord(
+					static_cast<openvdb::Int32>(std::floor((p.x() + shift) / cellWidth)),
+					static_cast<openvdb::Int32>(std::floor((p.y() + shift) / cellWidth)),
+					static_cast<openvdb::Int32>(std::floor((p.z() + shift) / cellWidth)));
+			}
+		});
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, order.size()), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				const Index32 v = order[n];
+				bool isFree = true;
+				for (auto it = vertexFaces[v].begin(); it != vertexFaces[v].end() && isFree; ++it) {
+					if (deadFace[*it]) continue;
+					const openvdb::Vec3I& t = triangles[*it];
+					isFree = (cells[t[0]] == cells[v] && cells[t[1]] == cells[v] && cells[t[2]] == cells[v]);
+				}
+				freeVertex[v] = isFree ? 1 : 0;
+			}
+		});
+
+		tbb::parallel_sort(order.begin(), order.end(), [&](Index32 a, Index32 b) {
+			if (cells[a] != cells[b]) return cells[a] < cells[b];
+			return a < b;
+		});
+
+		std::vector<std::pair<size_t, size_t>> ranges;
+		for (size_t n = 0; n < order.size();) {
+			size_t end = n + 1;
+			while (end < order.size() && cells[order[end]] == cells[order[n]]) {
+				end++;
+			}
+			ranges.push_back(std::make_pair(n, end));
+			n = end;
+		}
+
+		// every cell removes the same share of its faces to land near the requested count
+		const double removeRatio = (targetFaces > 0) ? 1.0 - static_cast<double>(targetFaces) / static_cast<double>(remaining) : 1.0;
+		std::atomic<size_t> collapsed(0);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, ranges.size(), 1), [&](const tbb::blocked_range<size_t>& r) {
+			openvdb::FloatGrid::ConstAccessor acc = grid.getConstAccessor();
+			SamplerT sampler(acc, grid.transform());
+
+			std::vector<Index32> uRing, vRing;
+
+			// distinct live neighbours of a vertex
+			auto ring = [&](Index32 x, std::vector<Index32>& out) {
+				out.clear();
+				for (auto it = vertexFaces[x].begin(); it != vertexFaces[x].end(); ++it) {
+					if (deadFace[*it]) continue;
+					for (int i = 0; i < 3; i++) {
+						const Index32 w = triangles[*it][i];
+						if (w != x && std::find(out.begin(), out.end(), w) == out.end()) {
+							out.push_back(w);
+						}
+					}
+				}
+			};
+
+			// cheapest placement of the merged vertex for edge (u, v)
+			auto candidate = [&](Index32 u, Index32 v) {
+				Quadric q = quadrics[u];
+				q += quadrics[v];
+
+				Collapse c;
+				c.u = u;
+				c.v = v;
+				c.uStamp = stamps[u];
+				c.vStamp = stamps[v];
+
+				if (!q.Optimum(c.position)) {
+					const openvdb::Vec3d mid = 0.5 * (positions[u] + positions[v]);
+					c.position = positions[u];
+					if (q.Error(positions[v]) < q.Error(c.position)) c.position = positions[v];
+					if (q.Error(mid) < q.Error(c.position)) c.position = mid;
+				}
+
+				// the area weighted error over the summed area is a mean squared distance, so it compares
+				// against the squared error bound whatever the voxel size
+				const double error = std::max(0.0, q.Error(c.position));
+				c.cost = (q.weight > 0.0) ? error / q.weight : error;
+				return c;
+			};
+
+			// faces around x other than the ones being collapsed must not fold over at the new position
+			auto folds = [&](Index32 x, Index32 other, const openvdb::Vec3d& p) {
+				for (auto it = vertexFaces[x].begin(); it != vertexFaces[x].end(); ++it) {
+					if (deadFace[*it]) continue;
+					const openvdb::Vec3I& t = triangles[*it];
+					if (t[0] == other || t[1] == other || t[2] == other) continue;
+
+					openvdb::Vec3d corners[3] = { positions[t[0]], positions[t[1]], positions[t[2]] };
+					const openvdb::Vec3d before = (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+					for (int i = 0; i < 3; i++) {
+						if (t[i] == x) corners[i] = p;
+					}
+					const openvdb::Vec3d after = (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+
+					if (before.dot(after) <= 0.25 * before.length() * after.length()) {
+						return true;
+					}
+				}
+				return false;
+			};
+
+			for (size_t c = r.begin(); c < r.end(); c++) {
+				std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+				size_t interior = 0;
+				for (size_t n = ranges[c].first; n < ranges[c].second; n++) {
+					const Index32 u = order[n];
+					if (!freeVertex[u]) continue;
+
+					interior += vertexFaces[u].size();
+
+					ring(u, uRing);
+					for (auto it = uRing.begin(); it != uRing.end(); ++it) {
+						if (*it > u && freeVertex[*it]) {
+							heap.push(candidate(u, *it));
+						}
+					}
+				}
+
+				// every interior face is counted once per corner
+				size_t budget = (removeRatio >= 1.0) ? std::numeric_limits<size_t>::max() : static_cast<size_t>(std::ceil(removeRatio * interior / 3.0));
+				size_t removed = 0;
+
+				while (!heap.empty() && removed < budget) {
+					const Collapse top = heap.top();
+					heap.pop();
+
+					const Index32 u = top.u, v = top.v;
+					if (deadVertex[u] || deadVertex[v] || stamps[u] != top.uStamp || stamps[v] != top.vStamp) {
+						continue;
+					}
+
+					if (top.cost > maxCost) {
+						break;
+					}
+
+					// link condition, the edge has to be shared by exactly two faces with two common neighbours
+					ring(u, uRing);
+					ring(v, vRing);
+
+					int common = 0;
+					for (auto it = uRing.begin(); it != uRing.end(); ++it) {
+						if (std::find(vRing.begin(), vRing.end(), *it) != vRing.end()) common++;
+					}
+
+					int shared = 0;
+					for (auto it = vertexFaces[u].begin(); it != vertexFaces[u].end(); ++it) {
+						if (deadFace[*it]) continue;
+						const openvdb::Vec3I& t = triangles[*it];
+						if (t[0] == v || t[1] == v || t[2] == v) shared++;
+					}
+
+					if (common != 2 || shared != 2) {
+						continue;
+					}
+
+					if (folds(u, v, top.position) || folds(v, u, top.position)) {
+						continue;
+					}
+
+					if (std::abs(sampler.wsSample(top.position) - isovalue) > surfaceTolerance) {
+						continue;
+					}
+
+					// merge u into v
+					for (auto it = vertexFaces[u].begin(); it != vertexFaces[u].end(); ++it) {
+						if (deadFace[*it]) continue;
+						openvdb::Vec3I& t = triangles[*it];
+						if (t[0] == v || t[1] == v || t[2] == v) {
+							deadFace[*it] = 1;
+							removed++;
+						}
+						else {
+							for (int i = 0; i < 3; i++) {
+								if (t[i] == u) t[i] = v;
+							}
+							vertexFaces[v].push_back(*it);
+						}
+					}
+
+					vertexFaces[u].clear();
+					vertexFaces[v].erase(std::remove_if(vertexFaces[v].begin(), vertexFaces[v].end(),
+						[&](Index32 f) { return deadFace[f] != 0; }), vertexFaces[v].end());
+
+					positions[v] = top.position;
+					quadrics[v] += quadrics[u];
+					deadVertex[u] = 1;
+					stamps[v]++;
+
+					ring(v, vRing);
+					for (auto it = vRing.begin(); it != vRing.end(); ++it) {
+						if (freeVertex[*it]) {
+							heap.push(candidate(std::min(v, *it), std::max(v, *it)));
+						}
+					}
+				}
+
+				liveFaces -= removed;
+				collapsed += removed;
+			}
+		});
+
+		if (collapsed.load() == 0 && (round % 2)) {
+			break;
+		}
+	}
+
+	// compact the surviving vertices and faces back into the mesh
+	std::vector<Index32> remap(vCount, openvdb::util::INVALID_IDX);
+
+	mVertices.clear();
+	mFaces.clear();
+	mNormals.clear();
+
+	for (size_t n = 0; n < tCount; n++) {
+		if (deadFace[n]) continue;
+
+		openvdb::Vec4I face(0, 0, 0, openvdb::util::INVALID_IDX);
+		for (int i = 0; i < 3; i++) {
+			const Index32 v = triangles[n][i];
+			if (remap[v] == openvdb::util::INVALID_IDX) {
+				remap[v] = static_cast<Index32>(mVertices.size());
+				mVertices.push_back(openvdb::Vec3s(positions[v]));
+			}
+			face[i] = remap[v];
+		}
+		mFaces.push_back(face);
+	}
+}
+
 void DendroMesh::Clear()
 {
 	mVertices.clear();
 	mFaces.clear();
+	mNormals.clear();
 }
 
+size_t DendroMesh::MemoryUsage() const
+{
+	return mVertices.capacity() * sizeof(openvdb::Vec3s)
+		+ mFaces.capacity() * sizeof(openvdb::Vec4I)
+		+ mNormals.capacity() * sizeof(openvdb::Vec3s);
+}
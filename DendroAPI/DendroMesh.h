@@ -13,12 +13,18 @@ public:
 	DendroMesh();
 	~DendroMesh();
 
-	DendroMesh Duplicate();
+	DendroMesh Duplicate() const;
 
-	bool IsValid();
+	bool IsValid() const;
 
-	std::vector<openvdb::Vec3s> Vertices();
-	std::vector<openvdb::Vec4I> Faces();
+	std::vector<openvdb::Vec3s> Vertices() const;
+	std::vector<openvdb::Vec4I> Faces() const;
+	std::vector<openvdb::Vec3s> Normals() const;
+
+	// malloc'd flat copies for the c api, the caller frees them
+	float * VertexBuffer(int& size) const;
+	int * FaceBuffer(int& size) const;
+	float * NormalBuffer(int& size) const;
 
 	void AddVertice(openvdb::Vec3s v);
 	void AddVertice(std::vector<openvdb::Vec3s> v);
@@ -26,11 +32,19 @@ public:
 	void AddFace(openvdb::Vec4I f);
 	void AddFace(std::vector<openvdb::Vec4I> f);
 
+	void Weld();
+	void ComputeNormals(const openvdb::FloatGrid& grid);
+	void Orient();
+	void Decimate(const openvdb::FloatGrid& grid, double isovalue, int targetFaces, double maxError);
+
 	void Clear();
 
+	size_t MemoryUsage() const;
+
 private:
 	std::vector<openvdb::Vec3s> mVertices;
 	std::vector<openvdb::Vec4I> mFaces;
+	std::vector<openvdb::Vec3s> mNormals;
 };
 
 #endif // __DENDROMESH_H__
\ No newline at end of file
@@ -33,7 +33,9 @@ public:
 		mParticleList.push_back(pa);
 	}
 
-	bool IsValid() {
+	void reserve(size_t count) { mParticleList.reserve(count); }
+
+	bool IsValid() const {
 		return (mParticleList.size() > 0) ? true : false;
 	}
 	void clear() { mParticleList.clear(); }
@@ -0,0 +1,512 @@
+#include "stdafx.h"
+#include "DendroRaster.h"
+#include "DendroTrace.h"
+
+#include <openvdb/tools/SignedFloodFill.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace {
+
+	using LeafT = openvdb::FloatTree::LeafNodeType;
+
+	const int DIM = LeafT::DIM;
+	const int LOG2DIM = LeafT::LOG2DIM;
+
+	// particles under 1.5 voxels are skipped, the same default as ParticlesToLevelSet
+	const double MIN_RADIUS = 1.5;
+
+	// contiguous slices of [0, total), several per thread so work stealing can even them out
+	struct Chunks {
+		explicit Chunks(size_t n) : total(n)
+		{
+			const size_t target = size_t(std::max(1, tbb::this_task_arena::max_concurrency())) * 8;
+			size = std::max<size_t>(4096, (n + target - 1) / target);
+			count = (n + size - 1) / size;
+		}
+
+		size_t Begin(size_t c) const { return c * size; }
+		size_t End(size_t c) const { return std::min(total, (c + 1) * size); }
+
+		size_t total;
+		size_t size;
+		size_t count;
+	};
+
+	// leaf coordinates packed relative to the lowest leaf, with just enough bits per axis
+	struct KeySpace {
+		openvdb::Coord min, max;
+		int bits[3];
+
+		bool Build(const openvdb::Coord& lo, const openvdb::Coord& hi)
+		{
+			// a leaf of margin on every side keeps neighbour lookups addressable
+			min = lo.offsetBy(-1);
+			max = hi.offsetBy(1);
+
+			for (int a = 0; a < 3; a++) {
+				const uint64_t range = uint64_t(int64_t(max[a]) - int64_t(min[a])) + 1;
+				bits[a] = 0;
+				while ((uint64_t(1) << bits[a]) < range) {
+					bits[a]++;
+				}
+			}
+
+			return Bits() <= 63;
+		}
+
+		int Bits() const { return bits[0] + bits[1] + bits[2]; }
+
+		bool Contains(const openvdb::Coord& leaf) const
+		{
+			return leaf.x() >= min.x() && leaf.y() >= min.y() && leaf.z() >= min.z() &&
+				leaf.x() <= max.x() && leaf.y() <= max.y() && leaf.z() <= max.z();
+		}
+
+		uint64_t Pack(const openvdb::Coord& leaf) const
+		{
+			return (uint64_t(leaf.x() - min.x()) << (bits[1] + bits[2])) |
+				(uint64_t(leaf.y() - min.y()) << bits[2]) |
+				uint64_t(leaf.z() - min.z());
+		}
+
+		openvdb::Coord Unpack(uint64_t key) const
+		{
+			return openvdb::Coord(
+				min.x() + int(key >> (bits[1] + bits[2])),
+				min.y() + int((key >> bits[2]) & ((uint64_t(1) << bits[1]) - 1)),
+				min.z() + int(key & ((uint64_t(1) << bits[2]) - 1)));
+		}
+	};
+
+	inline openvdb::Coord LeafOf(const openvdb::Vec3d& p)
+	{
+		return openvdb::Coord(
+			int(std::floor(p.x())) >> LOG2DIM,
+			int(std::floor(p.y())) >> LOG2DIM,
+			int(std::floor(p.z())) >> LOG2DIM);
+	}
+
+	inline openvdb::Coord OriginOf(const openvdb::Coord& leaf)
+	{
+		return openvdb::Coord(leaf.x() * DIM, leaf.y() * DIM, leaf.z() * DIM);
+	}
+
+	// parallel lsd counting sort on the low bits of the keys, 11 bits per pass. values follow their
+	// keys when given, the sort is stable so bins keep particle order
+	void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int bits)
+	{
+		const int RADIX = 11;
+		const size_t BUCKETS = size_t(1) << RADIX;
+
+		const size_t n = keys.size();
+		if (n < 2) {
+			return;
+		}
+
+		const bool payload = !values.empty();
+		const Chunks chunks(n);
+
+		std::vector<uint64_t> keysOut(n);
+		std::vector<uint32_t> valuesOut(payload ? n : 0);
+		std::vector<size_t> offsets(chunks.count * BUCKETS);
+
+		for (int shift = 0; shift < bits; shift += RADIX) {
+			tbb::parallel_for(size_t(0), chunks.count, [&](size_t c) {
+				size_t *count = &offsets[c * BUCKETS];
+				std::fill(count, count + BUCKETS, size_t(0));
+				for (size_t i = chunks.Begin(c); i < chunks.End(c); i++) {
+					count[(keys[i] >> shift) & (BUCKETS - 1)]++;
+				}
+			});
+
+			// bucket major prefix so every chunk scatters into its own stable slice
+			size_t sum = 0;
+			for (size_t b = 0; b < BUCKETS; b++) {
+				for (size_t c = 0; c < chunks.count; c++) {
+					size_t &offset = offsets[c * BUCKETS + b];
+					const size_t bucket = offset;
+					offset = sum;
+					sum += bucket;
+				}
+			}
+
+			tbb::parallel_for(size_t(0), chunks.count, [&](size_t c) {
+				size_t *offset = &offsets[c * BUCKETS];
+				for (size_t i = chunks.Begin(c); i < chunks.End(c); i++) {
+					const size_t to = offset[(keys[i] >> shift) & (BUCKETS - 1)]++;
+					keysOut[to] = keys[i];
+					if (payload) {
+						valuesOut[to] = values[i];
+					}
+				}
+			});
+
+			keys.swap(keysOut);
+			if (payload) {
+				values.swap(valuesOut);
+			}
+		}
+	}
+
+	// distinct keys of a sorted array and where each run starts, with the end appended
+	void Runs(const std::vector<uint64_t>& keys, std::vector<uint64_t>& unique, std::vector<size_t>& starts)
+	{
+		unique.clear();
+		starts.clear();
+
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (i == 0 || keys[i] != keys[i - 1]) {
+				unique.push_back(keys[i]);
+				starts.push_back(i);
+			}
+		}
+		starts.push_back(keys.size());
+	}
+
+	// minimum signed distance of one sphere into a leaf of distances, center relative to the leaf origin
+	inline void Splat(float * dist, float cx, float cy, float cz, float radius, float halfWidth)
+	{
+		const float reach = radius + halfWidth;
+		const float reach2 = reach * reach;
+
+		const int x0 = std::max(0, int(std::ceil(cx - reach))), x1 = std::min(DIM - 1, int(std::floor(cx + reach)));
+		const int y0 = std::max(0, int(std::ceil(cy - reach))), y1 = std::min(DIM - 1, int(std::floor(cy + reach)));
+		const int z0 = std::max(0, int(std::ceil(cz - reach))), z1 = std::min(DIM - 1, int(std::floor(cz + reach)));
+
+		for (int x = x0; x <= x1; x++) {
+			const float dx2 = (float(x) - cx) * (float(x) - cx);
+			for (int y = y0; y <= y1; y++) {
+				const float dxy2 = dx2 + (float(y) - cy) * (float(y) - cy);
+				if (dxy2 >= reach2) {
+					continue;
+				}
+
+				float *row = dist + ((x << (2 * LOG2DIM)) | (y << LOG2DIM));
+				for (int z = z0; z <= z1; z++) {
+					const float d2 = dxy2 + (float(z) - cz) * (float(z) - cz);
+					if (d2 < reach2) {
+						const float d = std::sqrt(d2) - radius;
+						row[z] = std::min(row[z], d);
+					}
+				}
+			}
+		}
+	}
+
+}
+
+DendroRaster::DendroRaster(double voxelSize, double bandwidth) : mVoxelSize(voxelSize), mBandwidth(bandwidth)
+{
+}
+
+openvdb::FloatGrid::Ptr DendroRaster::Spheres(const DendroParticle& points)
+{
+	DendroTrace::Span span("DendroRaster::Spheres");
+
+	const double inverseVoxelSize = 1.0 / mVoxelSize;
+	const double halfWidth = mBandwidth;
+	const size_t count = points.size();
+
+	if (count > std::numeric_limits<uint32_t>::max()) {
+		return openvdb::FloatGrid::Ptr();
+	}
+
+	openvdb::FloatGrid::Ptr grid = openvdb::createLevelSet<openvdb::FloatGrid>(mVoxelSize, mBandwidth);
+	const float background = grid->background();
+
+	// index space center and radius, false for particles too small to rasterize
+	auto sphere = [&](size_t n, openvdb::Vec3d& center, double& radius) {
+		openvdb::Vec3R pos;
+		openvdb::Real rad;
+		points.getPosRad(n, pos, rad);
+
+		center = pos * inverseVoxelSize;
+		radius = rad * inverseVoxelSize;
+		return radius >= MIN_RADIUS;
+	};
+
+	// spheres reaching no further than the neighbouring leaves are binned once by their center,
+	// larger ones are binned into every leaf they touch
+	const Chunks chunks(count);
+
+	std::vector<openvdb::Coord> lows(chunks.count), highs(chunks.count);
+	std::vector<size_t> smallOffsets(chunks.count + 1, 0), largeOffsets(chunks.count + 1, 0);
+
+	KeySpace keys;
+	std::vector<uint64_t> smallKeys, largeKeys;
+	std::vector<uint32_t> smallIds, largeIds;
+
+	{
+		DendroTrace::Span phase("bin particles");
+
+		tbb::parallel_for(size_t(0), chunks.count, [&](size_t c) {
+			openvdb::Coord lo(INT_MAX), hi(INT_MIN);
+			size_t small = 0, large = 0;
+
+			for (size_t n = chunks.Begin(c); n < chunks.End(c); n++) {
+				openvdb::Vec3d center;
+				double radius;
+				if (!sphere(n, center, radius)) {
+					continue;
+				}
+
+				const double reach = radius + halfWidth;
+				const openvdb::Coord a = LeafOf(center - openvdb::Vec3d(reach));
+				const openvdb::Coord b = LeafOf(center + openvdb::Vec3d(reach));
+
+				lo.minComponent(a);
+				hi.maxComponent(b);
+
+				if (reach <= DIM) {
+					small++;
+				}
+				else {
+					large += size_t(b.x() - a.x() + 1) * size_t(b.y() - a.y() + 1) * size_t(b.z() - a.z() + 1);
+				}
+			}
+
+			lows[c] = lo;
+			highs[c] = hi;
+			smallOffsets[c + 1] = small;
+			largeOffsets[c + 1] = large;
+		});
+
+		openvdb::Coord lo(INT_MAX), hi(INT_MIN);
+		for (size_t c = 0; c < chunks.count; c++) {
+			lo.minComponent(lows[c]);
+			hi.maxComponent(highs[c]);
+			smallOffsets[c + 1] += smallOffsets[c];
+			largeOffsets[c + 1] += largeOffsets[c];
+		}
+
+		if (smallOffsets.back() + largeOffsets.back() == 0) {
+			return grid;
+		}
+
+		if (!keys.Build(lo, hi)) {
+			return openvdb::FloatGrid::Ptr();
+		}
+
+		smallKeys.resize(smallOffsets.back());
+		smallIds.resize(smallOffsets.back());
+		largeKeys.resize(largeOffsets.back());
+		largeIds.resize(largeOffsets.back());
+
+		tbb::parallel_for(size_t(0), chunks.count, [&](size_t c) {
+			size_t s = smallOffsets[c], l = largeOffsets[c];
+
+			for (size_t n = chunks.Begin(c); n < chunks.End(c); n++) {
+				openvdb::Vec3d center;
+				double radius;
+				if (!sphere(n, center, radius)) {
+					continue;
+				}
+
+				const double reach = radius + halfWidth;
+				if (reach <= DIM) {
+					smallKeys[s] = keys.Pack(LeafOf(center));
+					smallIds[s++] = uint32_t(n);
+					continue;
+				}
+
+				const openvdb::Coord a = LeafOf(center - openvdb::Vec3d(reach));
+				const openvdb::Coord b = LeafOf(center + openvdb::Vec3d(reach));
+				for (int x = a.x(); x <= b.x(); x++) {
+					for (int y = a.y(); y <= b.y(); y++) {
+						for (int z = a.z(); z <= b.z(); z++) {
+							largeKeys[l] = keys.Pack(openvdb::Coord(x, y, z));
+							largeIds[l++] = uint32_t(n);
+						}
+					}
+				}
+			}
+		});
+	}
+
+	{
+		DendroTrace::Span phase("sort bins");
+		RadixSort(smallKeys, smallIds, keys.Bits());
+		RadixSort(largeKeys, largeIds, keys.Bits());
+	}
+
+	std::vector<uint64_t> binKeys, largeLeafKeys;
+	std::vector<size_t> binStarts, largeStarts;
+	Runs(smallKeys, binKeys, binStarts);
+	Runs(largeKeys, largeLeafKeys, largeStarts);
+
+	// small spheres in bin order with their centers relative to the bin origin, which keeps float
+	// precision far from the world origin and the fill loop on contiguous memory
+	std::vector<openvdb::Vec4f> records(smallIds.size());
+
+	struct Reach {
+		int8_t lo[3];
+		int8_t hi[3];
+	};
+	std::vector<Reach> reaches(binKeys.size());
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, binKeys.size()), [&](const tbb::blocked_range<size_t>& r) {
+		for (size_t b = r.begin(); b < r.end(); b++) {
+			const openvdb::Vec3d origin = OriginOf(keys.Unpack(binKeys[b])).asVec3d();
+			Reach reach = { { 0, 0, 0 }, { 0, 0, 0 } };
+
+			for (size_t i = binStarts[b]; i < binStarts[b + 1]; i++) {
+				openvdb::Vec3d center;
+				double radius;
+				sphere(smallIds[i], center, radius);
+
+				const openvdb::Vec3d local = center - origin;
+				records[i] = openvdb::Vec4f(float(local.x()), float(local.y()), float(local.z()), float(radius));
+
+				// which neighbouring leaves this bin spills into
+				for (int a = 0; a < 3; a++) {
+					if (std::ceil(local[a] - radius - halfWidth) < 0.0) {
+						reach.lo[a] = -1;
+					}
+					if (std::floor(local[a] + radius + halfWidth) >= DIM) {
+						reach.hi[a] = 1;
+					}
+				}
+			}
+
+			reaches[b] = reach;
+		}
+	});
+
+	std::vector<uint64_t>().swap(smallKeys);
+	std::vector<uint32_t>().swap(smallIds);
+
+	// every leaf any sphere reaches, each filled exactly once
+	std::vector<uint64_t> leafKeys;
+	{
+		DendroTrace::Span phase("collect leaves");
+
+		std::vector<size_t> offsets(binKeys.size() + 1, 0);
+		for (size_t b = 0; b < binKeys.size(); b++) {
+			const Reach& reach = reaches[b];
+			offsets[b + 1] = offsets[b] + size_t(reach.hi[0] - reach.lo[0] + 1) * size_t(reach.hi[1] - reach.lo[1] + 1) * size_t(reach.hi[2] - reach.lo[2] + 1);
+		}
+
+		leafKeys.resize(offsets.back() + largeLeafKeys.size());
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, binKeys.size()), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t b = r.begin(); b < r.end(); b++) {
+				const openvdb::Coord leaf = keys.Unpack(binKeys[b]);
+				const Reach& reach = reaches[b];
+
+				size_t i = offsets[b];
+				for (int x = reach.lo[0]; x <= reach.hi[0]; x++) {
+					for (int y = reach.lo[1]; y <= reach.hi[1]; y++) {
+						for (int z = reach.lo[2]; z <= reach.hi[2]; z++) {
+							leafKeys[i++] = keys.Pack(leaf.offsetBy(x, y, z));
+						}
+					}
+				}
+			}
+		});
+
+		std::copy(largeLeafKeys.begin(), largeLeafKeys.end(), leafKeys.begin() + offsets.back());
+
+		std::vector<uint32_t> none;
+		RadixSort(leafKeys, none, keys.Bits());
+		leafKeys.erase(std::unique(leafKeys.begin(), leafKeys.end()), leafKeys.end());
+	}
+
+	std::vector<LeafT*> leaves(leafKeys.size(), nullptr);
+
+	{
+		DendroTrace::Span phase("fill leaves");
+
+		const float hw = float(halfWidth);
+		const float voxelSize = float(mVoxelSize);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, leafKeys.size()), [&](const tbb::blocked_range<size_t>& r) {
+			float dist[LeafT::SIZE];
+
+			for (size_t n = r.begin(); n < r.end(); n++) {
+				const openvdb::Coord leaf = keys.Unpack(leafKeys[n]);
+				const openvdb::Coord origin = OriginOf(leaf);
+
+				std::fill(dist, dist + LeafT::SIZE, hw);
+
+				// small spheres can only come from this bin or its 26 neighbours
+				for (int x = -1; x <= 1; x++) {
+					for (int y = -1; y <= 1; y++) {
+						for (int z = -1; z <= 1; z++) {
+							const openvdb::Coord neighbour = leaf.offsetBy(x, y, z);
+							if (!keys.Contains(neighbour)) {
+								continue;
+							}
+
+							const uint64_t key = keys.Pack(neighbour);
+							auto it = std::lower_bound(binKeys.begin(), binKeys.end(), key);
+							if (it == binKeys.end() || *it != key) {
+								continue;
+							}
+
+							const size_t b = size_t(it - binKeys.begin());
+							const float sx = float(x * DIM), sy = float(y * DIM), sz = float(z * DIM);
+							for (size_t i = binStarts[b]; i < binStarts[b + 1]; i++) {
+								const openvdb::Vec4f& s = records[i];
+								Splat(dist, s[0] + sx, s[1] + sy, s[2] + sz, s[3], hw);
+							}
+						}
+					}
+				}
+
+				auto it = std::lower_bound(largeLeafKeys.begin(), largeLeafKeys.end(), leafKeys[n]);
+				if (it != largeLeafKeys.end() && *it == leafKeys[n]) {
+					const size_t b = size_t(it - largeLeafKeys.begin());
+					for (size_t i = largeStarts[b]; i < largeStarts[b + 1]; i++) {
+						openvdb::Vec3d center;
+						double radius;
+						sphere(largeIds[i], center, radius);
+
+						const openvdb::Vec3d local = center - origin.asVec3d();
+						Splat(dist, float(local.x()), float(local.y()), float(local.z()), float(radius), hw);
+					}
+				}
+
+				// the band is active, everything past it is background on the side it falls
+				LeafT *node = new LeafT(origin, background);
+				for (openvdb::Index offset = 0; offset < LeafT::SIZE; offset++) {
+					const float d = dist[offset];
+					if (d > -hw && d < hw) {
+						node->setValueOn(offset, d * voxelSize);
+					}
+					else {
+						node->setValueOff(offset, (d > 0.0f) ? background : -background);
+					}
+				}
+
+				if (node->isEmpty()) {
+					delete node;
+				}
+				else {
+					leaves[n] = node;
+				}
+			}
+		});
+	}
+
+	for (auto it = leaves.begin(); it != leaves.end(); ++it) {
+		if (*it != nullptr) {
+			grid->tree().addLeaf(*it);
+		}
+	}
+
+	// mark the interior with negative background tiles
+	DendroTrace::Span fill("signedFloodFill");
+	openvdb::tools::signedFloodFill(grid->tree());
+
+	return grid;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef __DENDRORASTER_H__
+#define __DENDRORASTER_H__
+
+#include "DendroParticle.h"
+
+#define IMATH_HALF_NO_LOOKUP_TABLE
+
+#include <openvdb/openvdb.h>
+
+// leaf binned sphere rasterizer. particles are counting sorted by the leaf holding their center,
+// then every output leaf is filled on its own from the spheres in its neighbouring bins, so no
+// thread ever writes a shared grid and nothing has to be merged afterwards
+class DendroRaster
+{
+public:
+	DendroRaster(double voxelSize, double bandwidth);
+
+	// level set of the union of all spheres, or null when the points span more leaves than the
+	// sort keys can address
+	openvdb::FloatGrid::Ptr Spheres(const DendroParticle& points);
+
+private:
+	double mVoxelSize;
+	double mBandwidth;
+};
+
+#endif // __DENDRORASTER_H__
@@ -0,0 +1,236 @@
+#include "stdafx.h"
+#include "DendroSlice.h"
+#include "DendroTrace.h"
+
+#include <openvdb/tools/Interpolation.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+DendroSlice::DendroSlice(const openvdb::FloatGrid& grid, double isovalue) : mGrid(grid), mIsovalue(static_cast<float>(isovalue))
+{
+	const openvdb::Vec3d voxelSize = grid.voxelSize();
+	mStep = std::min(voxelSize[0], std::min(voxelSize[1], voxelSize[2]));
+
+	// margin samples are pushed at least this far outside so every loop closes
+	const float background = std::abs(grid.background());
+	mOutside = mIsovalue + ((background > 0.0f) ? background : static_cast<float>(mStep));
+
+	openvdb::CoordBBox bbox;
+	mEmpty = !grid.tree().evalActiveVoxelBoundingBox(bbox);
+
+	// world corners of the active bounds, rotated grids included
+	for (int i = 0; i < 8 && !mEmpty; i++) {
+		const openvdb::Vec3d corner(
+			(i & 1) ? bbox.max().x() + 0.5 : bbox.min().x() - 0.5,
+			(i & 2) ? bbox.max().y() + 0.5 : bbox.min().y() - 0.5,
+			(i & 4) ? bbox.max().z() + 0.5 : bbox.min().z() - 0.5);
+		mCorners[i] = grid.indexToWorld(corner);
+	}
+}
+
+void DendroSlice::Stack(const openvdb::Vec3d& origin, const openvdb::Vec3d& normal, double spacing, int count, std::vector<float>& vertices, std::vector<int>& contours)
+{
+	DendroTrace::Span span("DendroSlice::Stack");
+
+	vertices.clear();
+	contours.clear();
+
+	if (mEmpty || count <= 0 || normal.length() <= 0.0) {
+		return;
+	}
+
+	// in plane frame with u x v along the normal, u taken across the least aligned axis
+	mNormal = normal.unit();
+
+	int axis = 0;
+	for (int a = 1; a < 3; a++) {
+		if (std::abs(mNormal[a]) < std::abs(mNormal[axis])) {
+			axis = a;
+		}
+	}
+
+	openvdb::Vec3d reference(0.0, 0.0, 0.0);
+	reference[axis] = 1.0;
+
+	mU = reference.cross(mNormal).unit();
+	mV = mNormal.cross(mU);
+
+	std::vector<Loops> slices(count);
+	tbb::parallel_for(0, count, [&](int s) {
+		Plane(origin + mNormal * (spacing * s), slices[s]);
+	});
+
+	DendroTrace::Span phase("copy contours");
+
+	for (int s = 0; s < count; s++) {
+		vertices.insert(vertices.end(), slices[s].vertices.begin(), slices[s].vertices.end());
+		for (auto it = slices[s].counts.begin(); it != slices[s].counts.end(); ++it) {
+			contours.push_back(s);
+			contours.push_back(*it);
+		}
+	}
+}
+
+void DendroSlice::Plane(const openvdb::Vec3d& origin, Loops& loops) const
+{
+	DendroTrace::Span span("DendroSlice::Plane");
+
+	// active bounds in plane coordinates, planes that miss them have nothing to contour
+	double dMin = std::numeric_limits<double>::max(), dMax = -dMin;
+	double uMin = dMin, uMax = -dMin;
+	double vMin = dMin, vMax = -dMin;
+
+	for (int i = 0; i < 8; i++) {
+		const openvdb::Vec3d p = mCorners[i] - origin;
+		dMin = std::min(dMin, p.dot(mNormal));
+		dMax = std::max(dMax, p.dot(mNormal));
+		uMin = std::min(uMin, p.dot(mU));
+		uMax = std::max(uMax, p.dot(mU));
+		vMin = std::min(vMin, p.dot(mV));
+		vMax = std::max(vMax, p.dot(mV));
+	}
+
+	if (dMin > 0.0 || dMax < 0.0) {
+		return;
+	}
+
+	// one sample of margin on every side
+	const double u0 = uMin - mStep;
+	const double v0 = vMin - mStep;
+	const size_t nu = static_cast<size_t>(std::ceil((uMax - uMin) / mStep)) + 3;
+	const size_t nv = static_cast<size_t>(std::ceil((vMax - vMin) / mStep)) + 3;
+
+	const openvdb::Vec3d corner = origin + mU * u0 + mV * v0;
+
+	// grid transforms are affine, so samples step through index space at a fixed stride
+	const openvdb::Vec3d start = mGrid.worldToIndex(corner);
+	const openvdb::Vec3d du = mGrid.worldToIndex(corner + mU * mStep) - start;
+	const openvdb::Vec3d dv = mGrid.worldToIndex(corner + mV * mStep) - start;
+
+	std::vector<float> values(nu * nv);
+
+	{
+		DendroTrace::Span phase("sample plane");
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, nv), [&](const tbb::blocked_range<size_t>& r) {
+			auto acc = mGrid.getConstAccessor();
+
+			for (size_t j = r.begin(); j < r.end(); j++) {
+				float *row = &values[j * nu];
+				for (size_t i = 0; i < nu; i++) {
+					const openvdb::Vec3d p = start + du * double(i) + dv * double(j);
+
+					// past the band only the sign matters, so only band voxels are interpolated
+					float value;
+					if (acc.probeValue(openvdb::Coord::round(p), value)) {
+						value = openvdb::tools::BoxSampler::sample(acc, p);
+					}
+
+					if (i == 0 || j == 0 || i == nu - 1 || j == nv - 1) {
+						value = std::max(value, mOutside);
+					}
+
+					row[i] = value;
+				}
+			}
+		});
+	}
+
+	// edge crossings are numbered with the u edges first, the u edge of sample k is k and its v
+	// edge is k + uEdges. each crossing leads to the next one along the contour
+	const int64_t uEdges = static_cast<int64_t>(nu * nv);
+	const float iso = mIsovalue;
+
+	std::vector<int64_t> next(static_cast<size_t>(2 * uEdges), -1);
+
+	{
+		DendroTrace::Span phase("marching squares");
+
+		// a crossing only starts a segment in the one cell that has the inside on its left, so cells
+		// never write the same entry
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, nv - 1), [&](const tbb::blocked_range<size_t>& r) {
+			for (size_t j = r.begin(); j < r.end(); j++) {
+				for (size_t i = 0; i + 1 < nu; i++) {
+					const size_t k = j * nu + i;
+
+					// corners and edges counter clockwise, edge e runs from corner e to corner e + 1
+					const float f[4] = { values[k], values[k + 1], values[k + nu + 1], values[k + nu] };
+					const bool in[4] = { f[0] < iso, f[1] < iso, f[2] < iso, f[3] < iso };
+					const int64_t edges[4] = {
+						static_cast<int64_t>(k),
+						uEdges + static_cast<int64_t>(k + 1),
+						static_cast<int64_t>(k + nu),
+						uEdges + static_cast<int64_t>(k) };
+
+					const int mask = (in[0] ? 1 : 0) | (in[1] ? 2 : 0) | (in[2] ? 4 : 0) | (in[3] ? 8 : 0);
+					if (mask == 0 || mask == 15) {
+						continue;
+					}
+
+					// saddles join the inside corners when the cell center is inside
+					const bool joined = (mask == 5 || mask == 10) ? (0.25f * (f[0] + f[1] + f[2] + f[3]) < iso) : true;
+
+					// segments run from an edge leaving the inside to the nearest edge entering it
+					for (int e = 0; e < 4; e++) {
+						if (!in[e] || in[(e + 1) & 3]) {
+							continue;
+						}
+
+						for (int s = 1; s < 4; s++) {
+							const int m = joined ? ((e + s) & 3) : ((e + 4 - s) & 3);
+							if (!in[m] && in[(m + 1) & 3]) {
+								next[edges[e]] = edges[m];
+								break;
+							}
+						}
+					}
+				}
+			}
+		});
+	}
+
+	DendroTrace::Span phase("trace contours");
+
+	auto crossing = [&](int64_t e) {
+		const bool vEdge = e >= uEdges;
+		const size_t k = static_cast<size_t>(vEdge ? e - uEdges : e);
+		const size_t i = k % nu;
+		const size_t j = k / nu;
+
+		const float f0 = values[k];
+		const float f1 = values[vEdge ? k + nu : k + 1];
+		const double t = double(iso - f0) / double(f1 - f0);
+
+		const double u = (double(i) + (vEdge ? 0.0 : t)) * mStep;
+		const double v = (double(j) + (vEdge ? t : 0.0)) * mStep;
+		return corner + mU * u + mV * v;
+	};
+
+	for (int64_t e = 0; e < 2 * uEdges; e++) {
+		if (next[e] < 0) {
+			continue;
+		}
+
+		int count = 0;
+		int64_t k = e;
+		do {
+			const openvdb::Vec3d p = crossing(k);
+			loops.vertices.push_back(static_cast<float>(p.x()));
+			loops.vertices.push_back(static_cast<float>(p.y()));
+			loops.vertices.push_back(static_cast<float>(p.z()));
+			count++;
+
+			const int64_t n = next[k];
+			next[k] = -1;
+			k = n;
+		} while (k >= 0 && k != e);
+
+		loops.counts.push_back(count);
+	}
+}
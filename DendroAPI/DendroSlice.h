@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef __DENDROSLICE_H__
+#define __DENDROSLICE_H__
+
+#define IMATH_HALF_NO_LOOKUP_TABLE
+
+#include <openvdb/openvdb.h>
+#include <vector>
+
+// planar cross sections straight from a level set. each plane is sampled at voxel spacing over
+// the active bounds and contoured with marching squares, so nothing is ever meshed in 3d
+class DendroSlice
+{
+public:
+	DendroSlice(const openvdb::FloatGrid& grid, double isovalue);
+
+	// closed contours of count planes spaced along the normal from origin, slices run in parallel.
+	// vertices are xyz triples and contours holds a slice index and vertex count per loop, in slice
+	// order. loops run counter clockwise about the normal around the inside, holes run clockwise
+	void Stack(const openvdb::Vec3d& origin, const openvdb::Vec3d& normal, double spacing, int count, std::vector<float>& vertices, std::vector<int>& contours);
+
+private:
+	struct Loops {
+		std::vector<float> vertices;
+		std::vector<int> counts;
+	};
+
+	void Plane(const openvdb::Vec3d& origin, Loops& loops) const;
+
+	const openvdb::FloatGrid& mGrid;
+	float mIsovalue;
+	float mOutside;
+	double mStep;
+	bool mEmpty;
+
+	openvdb::Vec3d mCorners[8];
+	openvdb::Vec3d mNormal;
+	openvdb::Vec3d mU;
+	openvdb::Vec3d mV;
+};
+
+#endif // __DENDROSLICE_H__
@@ -0,0 +1,130 @@
+#include "stdafx.h"
+#include "DendroTrace.h"
+
+#include <chrono>
+#include <cstdio>
+
+DendroTrace::Span::Span(const char * name) : mName(NULL), mStart(0)
+{
+	// a disabled trace costs a single relaxed load
+	DendroTrace& trace = DendroTrace::Instance();
+	if (trace.Enabled()) {
+		mName = name;
+		mStart = trace.Now();
+	}
+}
+
+DendroTrace::Span::~Span()
+{
+	if (mName) {
+		DendroTrace& trace = DendroTrace::Instance();
+		trace.Record(mName, mStart, trace.Now());
+	}
+}
+
+DendroTrace& DendroTrace::Instance()
+{
+	static DendroTrace instance;
+	return instance;
+}
+
+namespace {
+
+	int64_t Clock()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+}
+
+DendroTrace::DendroTrace() : mEnabled(false), mOrigin(Clock())
+{
+}
+
+void DendroTrace::Begin()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// buffers are kept for their threads, only the events of the last session are dropped
+	for (auto it = mBuffers.begin(); it != mBuffers.end(); ++it) {
+		std::lock_guard<std::mutex> bufferLock((*it)->mutex);
+		(*it)->events.clear();
+	}
+
+	mOrigin.store(Clock());
+	mEnabled.store(true);
+}
+
+bool DendroTrace::End(const char * path)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mEnabled.store(false);
+
+	FILE * file = std::fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+
+	std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool first = true;
+	for (auto it = mBuffers.begin(); it != mBuffers.end(); ++it) {
+		std::lock_guard<std::mutex> bufferLock((*it)->mutex);
+
+		if ((*it)->events.empty()) {
+			continue;
+		}
+
+		std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+			first ? "" : ",\n", (*it)->thread, (*it)->thread);
+		first = false;
+
+		// timestamps are microseconds as the format expects, kept at nanosecond resolution
+		for (auto e = (*it)->events.begin(); e != (*it)->events.end(); ++e) {
+			std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				e->name, (*it)->thread, e->start / 1000.0, e->duration / 1000.0);
+		}
+
+		(*it)->events.clear();
+	}
+
+	std::fprintf(file, "\n]}\n");
+
+	return std::fclose(file) == 0;
+}
+
+int64_t DendroTrace::Now()
+{
+	return Clock() - mOrigin.load(std::memory_order_relaxed);
+}
+
+DendroTrace::Buffer& DendroTrace::ThreadBuffer()
+{
+	// registered once per thread, the trace shares ownership so events outlive the thread
+	thread_local std::shared_ptr<Buffer> buffer;
+
+	if (!buffer) {
+		buffer = std::make_shared<Buffer>();
+		buffer->events.reserve(1024);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		buffer->thread = static_cast<int>(mBuffers.size()) + 1;
+		mBuffers.push_back(buffer);
+	}
+
+	return *buffer;
+}
+
+void DendroTrace::Record(const char * name, int64_t start, int64_t end)
+{
+	Buffer& buffer = ThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+
+	Event event;
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+	buffer.events.push_back(event);
+}
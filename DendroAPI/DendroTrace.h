@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef __DENDROTRACE_H__
+#define __DENDROTRACE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class DendroTrace
+{
+public:
+	// records one complete event from construction to destruction. span names must be
+	// string literals, only the pointer is stored while recording
+	class Span
+	{
+	public:
+		explicit Span(const char * name);
+		~Span();
+
+	private:
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+		const char * mName;
+		int64_t mStart;
+	};
+
+	static DendroTrace& Instance();
+
+	void Begin();
+	bool End(const char * path);
+
+	bool Enabled() { return mEnabled.load(std::memory_order_relaxed); }
+
+private:
+	struct Event {
+		const char * name;
+		int64_t start;
+		int64_t duration;
+	};
+
+	// each thread appends to its own buffer, the lock is only contended while writing out
+	struct Buffer {
+		std::mutex mutex;
+		std::vector<Event> events;
+		int thread;
+	};
+
+	DendroTrace();
+
+	int64_t Now();
+	Buffer& ThreadBuffer();
+	void Record(const char * name, int64_t start, int64_t end);
+
+	std::atomic<bool> mEnabled;
+	std::atomic<int64_t> mOrigin;
+	std::mutex mMutex;
+	std::vector<std::shared_ptr<Buffer>> mBuffers;
+};
+
+#endif // __DENDROTRACE_H__
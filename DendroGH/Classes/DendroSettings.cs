@@ -14,6 +14,8 @@ namespace DendroGH {
         private double mBandwidth = 1.0; // desired radius in voxel units around the surface
         private double mIsovalue = 0.01; // crossing point of the volume that is considered the surface
         private double mVoxelSize = 0.5; // size of voxels in the output volume
+        private int mFaceCount = 0; // target face count for mesh decimation, zero leaves the face count unbounded
+        private double mMaxError = 0.0; // maximum deviation allowed by mesh decimation, zero leaves the error unbounded
 #endregion Members
 
 #region Constructors
@@ -31,6 +33,8 @@ namespace DendroGH {
             this.mBandwidth = ds.Bandwidth;
             this.mIsovalue = ds.IsoValue;
             this.mVoxelSize = ds.VoxelSize;
+            this.mFaceCount = ds.FaceCount;
+            this.mMaxError = ds.MaxError;
         }
 #endregion Constructors
 
@@ -70,6 +74,24 @@ namespace DendroGH {
             get { return this.mAdaptivity; }
             set { this.mAdaptivity = value; }
         }
+
+        /// <summary>
+        /// face count property
+        /// </summary>
+        /// <returns>target face count for mesh decimation</returns>
+        public int FaceCount {
+            get { return this.mFaceCount; }
+            set { this.mFaceCount = value; }
+        }
+
+        /// <summary>
+        /// max error property
+        /// </summary>
+        /// <returns>maximum deviation allowed by mesh decimation</returns>
+        public double MaxError {
+            get { return this.mMaxError; }
+            set { this.mMaxError = value; }
+        }
 #endregion Properties
     }
 }
\ No newline at end of file
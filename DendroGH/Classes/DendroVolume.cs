@@ -1,4 +1,4 @@
-﻿using System;
+using System;
 using System.Collections.Generic;
 using System.IO;
 using System.Linq;
@@ -71,6 +71,41 @@ namespace DendroGH {
         #endif
         static private extern bool DendroTransform (IntPtr grid, double[] matrix, int mCount);
 
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroFromSphere (IntPtr grid, double[] matrix, int mCount, double radius, double voxelSize, double bandwidth);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroFromBox (IntPtr grid, double[] matrix, int mCount, double x, double y, double z, double voxelSize, double bandwidth);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroFromCylinder (IntPtr grid, double[] matrix, int mCount, double radius, double height, double voxelSize, double bandwidth);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroFromTorus (IntPtr grid, double[] matrix, int mCount, double majorRadius, double minorRadius, double voxelSize, double bandwidth);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroFromCapsule (IntPtr grid, double[] matrix, int mCount, double radius, double height, double voxelSize, double bandwidth);
+
         #if UNIX
         [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
         #else
@@ -92,6 +127,27 @@ namespace DendroGH {
         #endif
         static public extern void DendroIntersection (IntPtr grid, IntPtr csgGrid);
 
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static public extern void DendroSmoothUnion (IntPtr grid, IntPtr csgGrid, double radius, int kernel);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static public extern void DendroSmoothDifference (IntPtr grid, IntPtr csgGrid, double radius, int kernel);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static public extern void DendroSmoothIntersection (IntPtr grid, IntPtr csgGrid, double radius, int kernel);
+
         #if UNIX
         [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
         #else
@@ -141,6 +197,13 @@ namespace DendroGH {
         #endif
         static private extern IntPtr DendroClosestPoint(IntPtr grid, float[] vertices, int vCount, out int rSize);
 
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern IntPtr DendroSlice(IntPtr grid, double[] plane, int pCount, double spacing, int count, double isovalue, out int vSize, out IntPtr contours, out int cSize);
+
         #if UNIX
         [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
         #else
@@ -155,6 +218,13 @@ namespace DendroGH {
         #endif
         static private extern void DendroToMeshSettings (IntPtr grid, double isovalue, double adaptivity);
 
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroToMeshDecimate (IntPtr grid, double isovalue, double adaptivity, int targetFaces, double maxError);
+
         #if UNIX
         [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
         #else
@@ -168,6 +238,119 @@ namespace DendroGH {
         [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
         #endif
         static private extern IntPtr DendroFaceBuffer (IntPtr grid, out int size);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern IntPtr DendroNormalBuffer (IntPtr grid, out int size);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroToMeshBuffers (IntPtr grid, double isovalue, double adaptivity, int targetFaces, double maxError, out IntPtr vertices, out int vSize, out IntPtr faces, out int fSize, out IntPtr normals, out int nSize);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroExportMesh (IntPtr grid, string filename, int format, double isovalue, double adaptivity);
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroToDense (IntPtr grid, double[] bbox, int bCount, bool world, int step, float[] buffer, long[] strides, int[] dims);
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroFromDense (IntPtr grid, double[] bbox, int bCount, bool world, int step, float[] buffer, long[] strides, double threshold);
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroFromDenseCreate (IntPtr grid, double[] bbox, int bCount, bool world, int step, float[] buffer, long size, long[] strides, double threshold, double voxelSize, double bandwidth, bool levelSet);
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroOffsetBatch (IntPtr[] grids, int gCount, double[] amounts, int aCount);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroSmoothBatch (IntPtr[] grids, int gCount, int[] types, int[] iterations, int[] widths, int pCount);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroToMeshBatch (IntPtr[] grids, int gCount, double isovalue, double adaptivity, int targetFaces, double maxError);
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroToMeshDefaultBatch (IntPtr[] grids, int gCount);
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroCompact (IntPtr grid, double halfWidth);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroSetMemoryBudget (long bytes);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern long DendroMemoryUsage ();
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroSetFilterEngine (int engine);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroSetSweepThreshold (double voxels);
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern void DendroTraceBegin ();
+
+        #if UNIX
+        [DllImport("libDendroAPI.dylib", CallingConvention = CallingConvention.Cdecl)]
+        #else
+        [DllImport("DendroAPI.dll", CallingConvention = CallingConvention.Cdecl)]
+        #endif
+        static private extern bool DendroTraceEnd (string filename);
 #endregion PInvokes
 
 #region Members
@@ -394,6 +577,32 @@ namespace DendroGH {
             return true;
         }
 
+        /// <summary>
+        /// stream the volume surface straight to a mesh file without building a rhino mesh
+        /// </summary>
+        /// <param name="vFile">full path and name of the file to write (stl, ply or obj extension)</param>
+        /// <param name="vSettings">settings for meshing the volume</param>
+        /// <returns>boolean value for whether file write was successful</returns>
+        public bool ExportMesh (string vFile, DendroSettings vSettings) {
+            int format;
+            switch (Path.GetExtension (vFile).ToLowerInvariant ()) {
+                case ".stl":
+                    format = 0;
+                    break;
+                case ".ply":
+                    format = 1;
+                    break;
+                case ".obj":
+                    format = 2;
+                    break;
+                default:
+                    return false;
+            }
+
+            // pinvoke streaming export
+            return DendroExportMesh (this.Grid, vFile, format, vSettings.IsoValue, vSettings.Adaptivity);
+        }
+
         /// <summary>
         /// build a volume from a mesh input
         /// </summary>
@@ -704,6 +913,75 @@ namespace DendroGH {
             return csg;
         }
 
+        /// <summary>
+        /// compute a boolean union of a volume with the seam filleted
+        /// </summary>
+        /// <param name="vUnion">volume to combine with</param>
+        /// <param name="radius">blend radius in world units, capped at the narrow band width</param>
+        /// <param name="kernel">0 for a polynomial blend, 1 for an exponential one</param>
+        /// <returns>new volume with the resulting union</returns>
+        public DendroVolume SmoothUnion (DendroVolume vUnion, double radius, int kernel) {
+            if (!this.IsValid)
+                return new DendroVolume ();
+
+            if (!vUnion.IsValid)
+                return new DendroVolume (this);
+
+            DendroVolume csg = new DendroVolume (this);
+
+            // pinvoke smooth union function
+            DendroSmoothUnion (csg.Grid, vUnion.Grid, radius, kernel);
+            csg.UpdateDisplay ();
+
+            return csg;
+        }
+
+        /// <summary>
+        /// compute a boolean difference of a volume with the seam filleted
+        /// </summary>
+        /// <param name="vSubtract">volume to combine with</param>
+        /// <param name="radius">blend radius in world units, capped at the narrow band width</param>
+        /// <param name="kernel">0 for a polynomial blend, 1 for an exponential one</param>
+        /// <returns>new volume with the resulting difference</returns>
+        public DendroVolume SmoothDifference (DendroVolume vSubtract, double radius, int kernel) {
+            if (!this.IsValid)
+                return new DendroVolume ();
+
+            if (!vSubtract.IsValid)
+                return new DendroVolume (this);
+
+            DendroVolume csg = new DendroVolume (this);
+
+            // pinvoke smooth difference function
+            DendroSmoothDifference (csg.Grid, vSubtract.Grid, radius, kernel);
+            csg.UpdateDisplay ();
+
+            return csg;
+        }
+
+        /// <summary>
+        /// compute a boolean intersection of a volume with the seam filleted
+        /// </summary>
+        /// <param name="vIntersect">volume to combine with</param>
+        /// <param name="radius">blend radius in world units, capped at the narrow band width</param>
+        /// <param name="kernel">0 for a polynomial blend, 1 for an exponential one</param>
+        /// <returns>new volume with the resulting intersection</returns>
+        public DendroVolume SmoothIntersection (DendroVolume vIntersect, double radius, int kernel) {
+            if (!this.IsValid)
+                return new DendroVolume ();
+
+            if (!vIntersect.IsValid)
+                return new DendroVolume (this);
+
+            DendroVolume csg = new DendroVolume (this);
+
+            // pinvoke smooth intersection function
+            DendroSmoothIntersection (csg.Grid, vIntersect.Grid, radius, kernel);
+            csg.UpdateDisplay ();
+
+            return csg;
+        }
+
         /// <summary>
         /// apply an offset to the volume
         /// </summary>
@@ -860,6 +1138,223 @@ namespace DendroGH {
             return blend;
         }
 
+        /// <summary>
+        /// build volume from an analytic sphere
+        /// </summary>
+        /// <param name="vPlane">plane at the center of the sphere</param>
+        /// <param name="radius">sphere radius</param>
+        /// <param name="vSettings">voxelization settings to be used</param>
+        /// <returns>boolean with whether operation was successful</returns>
+        public bool CreateSphere (Plane vPlane, double radius, DendroSettings vSettings) {
+            double[] matrix = PrimitiveMatrix (vPlane, vSettings);
+
+            // pinvoke build volume from sphere
+            this.IsValid = DendroFromSphere (this.Grid, matrix, matrix.Length, radius, vSettings.VoxelSize, vSettings.Bandwidth);
+
+            return this.FinishPrimitive ();
+        }
+
+        /// <summary>
+        /// build volume from an analytic box
+        /// </summary>
+        /// <param name="vPlane">plane at the center of the box</param>
+        /// <param name="x">size of the box along the plane x axis</param>
+        /// <param name="y">size of the box along the plane y axis</param>
+        /// <param name="z">size of the box along the plane normal</param>
+        /// <param name="vSettings">voxelization settings to be used</param>
+        /// <returns>boolean with whether operation was successful</returns>
+        public bool CreateBox (Plane vPlane, double x, double y, double z, DendroSettings vSettings) {
+            double[] matrix = PrimitiveMatrix (vPlane, vSettings);
+
+            // pinvoke build volume from box
+            this.IsValid = DendroFromBox (this.Grid, matrix, matrix.Length, x, y, z, vSettings.VoxelSize, vSettings.Bandwidth);
+
+            return this.FinishPrimitive ();
+        }
+
+        /// <summary>
+        /// build volume from an analytic cylinder
+        /// </summary>
+        /// <param name="vPlane">plane at the base of the cylinder, the cylinder extends along its normal</param>
+        /// <param name="radius">cylinder radius</param>
+        /// <param name="height">cylinder height</param>
+        /// <param name="vSettings">voxelization settings to be used</param>
+        /// <returns>boolean with whether operation was successful</returns>
+        public bool CreateCylinder (Plane vPlane, double radius, double height, DendroSettings vSettings) {
+            double[] matrix = PrimitiveMatrix (vPlane, vSettings);
+
+            // pinvoke build volume from cylinder
+            this.IsValid = DendroFromCylinder (this.Grid, matrix, matrix.Length, radius, height, vSettings.VoxelSize, vSettings.Bandwidth);
+
+            return this.FinishPrimitive ();
+        }
+
+        /// <summary>
+        /// build volume from an analytic torus
+        /// </summary>
+        /// <param name="vPlane">plane at the center of the torus</param>
+        /// <param name="majorRadius">radius of the torus ring</param>
+        /// <param name="minorRadius">radius of the torus tube</param>
+        /// <param name="vSettings">voxelization settings to be used</param>
+        /// <returns>boolean with whether operation was successful</returns>
+        public bool CreateTorus (Plane vPlane, double majorRadius, double minorRadius, DendroSettings vSettings) {
+            double[] matrix = PrimitiveMatrix (vPlane, vSettings);
+
+            // pinvoke build volume from torus
+            this.IsValid = DendroFromTorus (this.Grid, matrix, matrix.Length, majorRadius, minorRadius, vSettings.VoxelSize, vSettings.Bandwidth);
+
+            return this.FinishPrimitive ();
+        }
+
+        /// <summary>
+        /// build volume from an analytic capsule
+        /// </summary>
+        /// <param name="vPlane">plane at the start of the capsule axis, the axis extends along its normal</param>
+        /// <param name="radius">capsule radius</param>
+        /// <param name="height">length of the capsule axis</param>
+        /// <param name="vSettings">voxelization settings to be used</param>
+        /// <returns>boolean with whether operation was successful</returns>
+        public bool CreateCapsule (Plane vPlane, double radius, double height, DendroSettings vSettings) {
+            double[] matrix = PrimitiveMatrix (vPlane, vSettings);
+
+            // pinvoke build volume from capsule
+            this.IsValid = DendroFromCapsule (this.Grid, matrix, matrix.Length, radius, height, vSettings.VoxelSize, vSettings.Bandwidth);
+
+            return this.FinishPrimitive ();
+        }
+
+        /// <summary>
+        /// prune the volume and rebuild its narrow band, releasing any cached data
+        /// </summary>
+        /// <param name="halfWidth">narrow band half width in voxels, zero keeps the current width</param>
+        public void Compact (double halfWidth = 0.0) {
+            if (!this.IsValid)
+                return;
+
+            // pinvoke compact function
+            DendroCompact (this.Grid, halfWidth);
+        }
+
+        /// <summary>
+        /// set the memory budget shared by all live volumes and cached results. once reached, cached
+        /// results are dropped first, then native copies of display meshes already read back, and
+        /// only then are least recently used volumes compacted
+        /// </summary>
+        /// <param name="bytes">budget in bytes, zero leaves memory unbounded</param>
+        public static void SetMemoryBudget (long bytes) {
+            DendroSetMemoryBudget (bytes);
+        }
+
+        /// <summary>
+        /// memory currently held by all live volumes
+        /// </summary>
+        /// <returns>memory usage in bytes</returns>
+        public static long MemoryUsage () {
+            return DendroMemoryUsage ();
+        }
+
+        /// <summary>
+        /// select the engine used for mean and gaussian smoothing of every volume
+        /// </summary>
+        /// <param name="engine">0 for the openvdb filters, 1 for the dense block filters</param>
+        public static void SetFilterEngine (int engine) {
+            DendroSetFilterEngine (engine);
+        }
+
+        /// <summary>
+        /// set the offset distance past which volumes are offset by fast sweeping instead of front tracking
+        /// </summary>
+        /// <param name="voxels">threshold in voxels, negative to always track the front</param>
+        public static void SetSweepThreshold (double voxels) {
+            DendroSetSweepThreshold (voxels);
+        }
+
+        /// <summary>
+        /// start recording a timeline of every volume operation
+        /// </summary>
+        public static void TraceBegin () {
+            DendroTraceBegin ();
+        }
+
+        /// <summary>
+        /// stop recording and write the timeline as a chrome trace-event file
+        /// </summary>
+        /// <param name="vFile">path of the json file to write</param>
+        /// <returns>boolean value for whether the file was written</returns>
+        public static bool TraceEnd (string vFile) {
+            return DendroTraceEnd (vFile);
+        }
+
+        /// <summary>
+        /// offset a set of volumes concurrently in a single call
+        /// </summary>
+        /// <param name="vVolumes">volumes to offset</param>
+        /// <param name="amounts">offset amount for every volume, or a single amount used for all of them</param>
+        /// <param name="vSettings">settings used to mesh the results, null meshes them like a single volume update</param>
+        /// <returns>offset volumes in the same order as supplied</returns>
+        public static List<DendroVolume> Offset (List<DendroVolume> vVolumes, List<double> amounts, DendroSettings vSettings) {
+            // one amount per volume or a single shared one, anything else leaves every result invalid
+            if (amounts.Count != 1 && amounts.Count != vVolumes.Count)
+                return vVolumes.Select (v => new DendroVolume ()).ToList ();
+
+            List<DendroVolume> offsets = DuplicateBatch (vVolumes);
+
+            IntPtr[] grids = offsets.Select (v => v.IsValid ? v.Grid : IntPtr.Zero).ToArray ();
+
+            // pinvoke batch offset function
+            DendroOffsetBatch (grids, grids.Length, amounts.ToArray (), amounts.Count);
+
+            UpdateDisplay (offsets, grids, vSettings);
+
+            return offsets;
+        }
+
+        /// <summary>
+        /// smooth a set of volumes concurrently in a single call
+        /// </summary>
+        /// <param name="vVolumes">volumes to smooth</param>
+        /// <param name="sType">0 - gaussian, 1 - laplacian, 2 - mean, 3 - median</param>
+        /// <param name="sIterations">number of smoothing operations to perform</param>
+        /// <param name="sWidth">width of the mean-value filter is 2*width+1 voxels</param>
+        /// <param name="vSettings">settings used to mesh the results, null meshes them like a single volume update</param>
+        /// <returns>smoothed volumes in the same order as supplied</returns>
+        public static List<DendroVolume> Smooth (List<DendroVolume> vVolumes, int sType, int sIterations, int sWidth, DendroSettings vSettings) {
+            if (sType < 0 || sType > 3)
+                sType = 1;
+
+            if (sWidth < 1)
+                sWidth = 1;
+
+            if (sIterations < 1)
+                sIterations = 1;
+
+            List<DendroVolume> smooths = DuplicateBatch (vVolumes);
+
+            IntPtr[] grids = smooths.Select (v => v.IsValid ? v.Grid : IntPtr.Zero).ToArray ();
+
+            // pinvoke batch smoothing function
+            DendroSmoothBatch (grids, grids.Length, new int[] { sType }, new int[] { sIterations }, new int[] { sWidth }, 1);
+
+            UpdateDisplay (smooths, grids, vSettings);
+
+            return smooths;
+        }
+
+        /// <summary>
+        /// copy every valid volume of a batch so the inputs are left untouched
+        /// </summary>
+        /// <param name="vVolumes">volumes to copy</param>
+        /// <returns>copied volumes, invalid inputs become empty volumes</returns>
+        private static List<DendroVolume> DuplicateBatch (List<DendroVolume> vVolumes) {
+            List<DendroVolume> copies = new List<DendroVolume> ();
+
+            foreach (DendroVolume volume in vVolumes) {
+                copies.Add ((volume != null && volume.IsValid) ? new DendroVolume (volume) : new DendroVolume ());
+            }
+
+            return copies;
+        }
+
         public List<Point3d> ClosestPoint(List<Point3d> vPoints)
         {
             // create point array from point3d list so we can pass to c++
@@ -903,35 +1398,142 @@ namespace DendroGH {
 
             return cPoints;
         }
-        #endregion Methods
 
-#region Display
         /// <summary>
-        /// update the mesh representation of the volume
+        /// cut the volume with a stack of parallel planes
         /// </summary>
-        public void UpdateDisplay () {
-            // pinvoke mesh update
-            DendroToMesh (this.Grid);
+        /// <param name="vPlane">first slice plane, further slices step along its normal</param>
+        /// <param name="spacing">distance between slices</param>
+        /// <param name="count">number of slices</param>
+        /// <param name="isovalue">iso surface to contour</param>
+        /// <returns>closed contours of each slice, counter clockwise about the normal around solid regions</returns>
+        public List<Polyline>[] Slice(Plane vPlane, double spacing, int count, double isovalue)
+        {
+            List<Polyline>[] slices = new List<Polyline>[Math.Max(count, 0)];
+            for (int s = 0; s < slices.Length; s++)
+                slices[s] = new List<Polyline>();
 
-            // get update vertex and face arrays
-            float[] vertices = this.GetMeshVertices ();
-            int[] faces = this.GetMeshFaces ();
+            double[] plane = {
+                vPlane.OriginX, vPlane.OriginY, vPlane.OriginZ,
+                vPlane.ZAxis.X, vPlane.ZAxis.Y, vPlane.ZAxis.Z
+            };
+
+            // pinvoke slice function, both buffers are allocated on the c++ side
+            IntPtr cppVertices = DendroSlice(this.Grid, plane, plane.Length, spacing, count, isovalue, out int vSize, out IntPtr cppContours, out int cSize);
 
-            this.Display = this.ConstructMesh (vertices, faces);
+            if (cppVertices == IntPtr.Zero)
+                return slices;
 
-            if (!this.Display.IsValid)
+            float[] vertices = new float[vSize];
+            int[] contours = new int[cSize];
+            Marshal.Copy(cppVertices, vertices, 0, vSize);
+            Marshal.Copy(cppContours, contours, 0, cSize);
+
+            Marshal.FreeHGlobal(cppVertices);
+            Marshal.FreeHGlobal(cppContours);
+
+            // each contour is a slice index and a vertex count, the vertices follow on in order
+            int v = 0;
+            for (int c = 0; c < cSize; c += 2)
             {
-                this.Display.Vertices.CombineIdentical(true, true);
-                this.Display.Faces.CullDegenerateFaces();
-                this.Display.Vertices.CullUnused();
-                this.Display.RebuildNormals();
-            } else {
-                // flip and rebuild
-                this.Display.Normals.ComputeNormals();
+                Polyline loop = new Polyline(contours[c + 1] + 1);
+                for (int i = 0; i < contours[c + 1]; i++, v += 3)
+                    loop.Add(vertices[v], vertices[v + 1], vertices[v + 2]);
+
+                loop.Add(loop[0]);
+                slices[contours[c]].Add(loop);
             }
 
+            return slices;
+        }
+
+        /// <summary>
+        /// copy a box of the volume into a flat array, x varying fastest
+        /// </summary>
+        /// <param name="vBox">box to copy</param>
+        /// <param name="world">true for a world space box, false for voxel indices</param>
+        /// <param name="step">voxels per sample along each axis, 1 copies every voxel</param>
+        /// <param name="dims">samples along x, y and z</param>
+        /// <returns>sample values or null if the box is empty</returns>
+        public float[] ToDense(BoundingBox vBox, bool world, int step, out int[] dims)
+        {
+            double[] bbox = { vBox.Min.X, vBox.Min.Y, vBox.Min.Z, vBox.Max.X, vBox.Max.Y, vBox.Max.Z };
+            dims = new int[3];
+
+            // pinvoke once for the size, then again to fill the array in place
+            if (!DendroToDense(this.Grid, bbox, bbox.Length, world, step, null, null, dims))
+                return null;
+
+            float[] values = new float[(long)dims[0] * dims[1] * dims[2]];
+            DendroToDense(this.Grid, bbox, bbox.Length, world, step, values, null, dims);
+
+            return values;
+        }
+
+        /// <summary>
+        /// write a flat array, x varying fastest, back into a box of the volume
+        /// </summary>
+        /// <param name="vBox">box to write</param>
+        /// <param name="world">true for a world space box, false for voxel indices</param>
+        /// <param name="step">voxels per sample along each axis, each sample fills its block</param>
+        /// <param name="values">sample values as returned by ToDense</param>
+        /// <param name="threshold">values past this are dropped from the grid, 0 keeps them all</param>
+        /// <returns>boolean value for whether the values were written</returns>
+        public bool FromDense(BoundingBox vBox, bool world, int step, float[] values, double threshold)
+        {
+            double[] bbox = { vBox.Min.X, vBox.Min.Y, vBox.Min.Z, vBox.Max.X, vBox.Max.Y, vBox.Max.Z };
+            int[] dims = new int[3];
+
+            if (!DendroToDense(this.Grid, bbox, bbox.Length, world, step, null, null, dims))
+                return false;
+
+            // the c++ side reads the array in place, so it has to cover the whole box
+            if (values == null || values.LongLength < (long)dims[0] * dims[1] * dims[2])
+                return false;
+
+            return DendroFromDense(this.Grid, bbox, bbox.Length, world, step, values, null, threshold);
+        }
+
+        /// <summary>
+        /// build the volume from a flat array, x varying fastest, replacing whatever it held
+        /// </summary>
+        /// <param name="vBox">box the array covers</param>
+        /// <param name="world">true for a world space box, false for voxel indices</param>
+        /// <param name="step">voxels per sample along each axis, each sample fills its block</param>
+        /// <param name="values">sample values, signed distances for a level set or densities for a fog volume</param>
+        /// <param name="threshold">values past this are dropped from the grid, 0 keeps them all</param>
+        /// <param name="vSettings">voxel size and bandwidth of the new volume</param>
+        /// <param name="levelSet">true for a level set, false for a fog volume</param>
+        /// <returns>boolean value for whether the volume was built</returns>
+        public bool FromDense(BoundingBox vBox, bool world, int step, float[] values, double threshold, DendroSettings vSettings, bool levelSet)
+        {
+            if (values == null)
+                return false;
+
+            if (vSettings.VoxelSize < 0.01)
+                vSettings.VoxelSize = 0.01;
+
+            if (vSettings.Bandwidth < 1)
+                vSettings.Bandwidth = 1;
+
+            double[] bbox = { vBox.Min.X, vBox.Min.Y, vBox.Min.Z, vBox.Max.X, vBox.Max.Y, vBox.Max.Z };
+
+            // the c++ side sizes the box against the new transform and checks the array covers it
+            this.IsValid = DendroFromDenseCreate(this.Grid, bbox, bbox.Length, world, step, values, values.LongLength, null, threshold, vSettings.VoxelSize, vSettings.Bandwidth, levelSet);
+
+            return this.IsValid;
+        }
+        #endregion Methods
 
+#region Display
+        /// <summary>
+        /// update the mesh representation of the volume
+        /// </summary>
+        public void UpdateDisplay () {
+            // pinvoke mesh update
+            DendroToMesh (this.Grid);
 
+            this.ReadDisplay ();
         }
 
         /// <summary>
@@ -939,27 +1541,76 @@ namespace DendroGH {
         /// </summary>
         /// <param name="vSettings">settings for meshing volume</param>
         public void UpdateDisplay (DendroSettings vSettings) {
-            // pinvoke mesh update
-            DendroToMeshSettings (this.Grid, vSettings.IsoValue, vSettings.Adaptivity);
+            // pinvoke mesh update, decimating in c++ when a face count or error bound is set
+            if (vSettings.FaceCount > 0 || vSettings.MaxError > 0) {
+                DendroToMeshDecimate (this.Grid, vSettings.IsoValue, vSettings.Adaptivity, vSettings.FaceCount, vSettings.MaxError);
+            }
+            else {
+                DendroToMeshSettings (this.Grid, vSettings.IsoValue, vSettings.Adaptivity);
+            }
 
-            // get update vertex and face arrays
-            float[] vertices = this.GetMeshVertices ();
-            int[] faces = this.GetMeshFaces ();
+            this.ReadDisplay ();
+        }
 
-            this.Display = this.ConstructMesh (vertices, faces);
+        /// <summary>
+        /// mesh the volume without touching its display mesh, safe to call from several threads at once
+        /// </summary>
+        /// <param name="vSettings">settings for meshing the volume</param>
+        /// <returns>new mesh of the volume</returns>
+        public Mesh ToMesh (DendroSettings vSettings) {
+            // pinvoke mesh into new buffers
+            DendroToMeshBuffers (this.Grid, vSettings.IsoValue, vSettings.Adaptivity, vSettings.FaceCount, vSettings.MaxError,
+                out IntPtr cppVertices, out int vSize, out IntPtr cppFaces, out int fSize, out IntPtr cppNormals, out int nSize);
+
+            float[] vertices = new float[vSize];
+            int[] faces = new int[fSize];
+            float[] normals = new float[nSize];
+
+            if (vSize > 0)
+                Marshal.Copy (cppVertices, vertices, 0, vSize);
+            if (fSize > 0)
+                Marshal.Copy (cppFaces, faces, 0, fSize);
+            if (nSize > 0)
+                Marshal.Copy (cppNormals, normals, 0, nSize);
+
+            Marshal.FreeHGlobal (cppVertices);
+            Marshal.FreeHGlobal (cppFaces);
+            Marshal.FreeHGlobal (cppNormals);
+
+            return this.ConstructMesh (vertices, faces, normals);
+        }
 
-            if (!this.Display.IsValid)
-            {
-                this.Display.Vertices.CombineIdentical(true, true);
-                this.Display.Faces.CullDegenerateFaces();
-                this.Display.Vertices.CullUnused();
-                this.Display.RebuildNormals();
+        /// <summary>
+        /// update the mesh representation of a batch of volumes concurrently
+        /// </summary>
+        /// <param name="vVolumes">volumes to update</param>
+        /// <param name="grids">grid pointers of the volumes, zero for invalid volumes</param>
+        /// <param name="vSettings">settings for meshing volumes, null for the defaults of UpdateDisplay ()</param>
+        private static void UpdateDisplay (List<DendroVolume> vVolumes, IntPtr[] grids, DendroSettings vSettings) {
+            // pinvoke batch mesh update, decimating the same way as a single volume update
+            if (vSettings == null) {
+                DendroToMeshDefaultBatch (grids, grids.Length);
             }
+            else {
+                DendroToMeshBatch (grids, grids.Length, vSettings.IsoValue, vSettings.Adaptivity, vSettings.FaceCount, vSettings.MaxError);
+            }
+
+            foreach (DendroVolume volume in vVolumes) {
+                if (volume.IsValid)
+                    volume.ReadDisplay ();
+            }
+        }
+
+        /// <summary>
+        /// rebuild the display mesh from the buffers of the last c++ mesh update
+        /// </summary>
+        private void ReadDisplay () {
+            // get update vertex, face, and normal arrays. the mesh comes back welded and oriented
+            float[] vertices = this.GetMeshVertices ();
+            int[] faces = this.GetMeshFaces ();
+            float[] normals = this.GetMeshNormals ();
 
-            // flip and rebuild
-            this.Display.UnifyNormals();
-            this.Display.Normals.ComputeNormals();
-            this.Display.Flip(true, true, true);
+            this.Display = this.ConstructMesh (vertices, faces, normals);
         }
 
         /// <summary>
@@ -1005,12 +1656,34 @@ namespace DendroGH {
         }
 
         /// <summary>
-        /// build mesh from vertex and face array
+        /// gets normal buffer array over from c++
+        /// </summary>
+        /// <returns>normal array</returns>
+        private float[] GetMeshNormals () {
+            float[] result = null;
+
+            IntPtr normals = IntPtr.Zero;
+
+            // pinvoke normal buffer
+            normals = DendroNormalBuffer (this.Grid, out int size);
+            if (normals != IntPtr.Zero) {
+                result = new float[size];
+                Marshal.Copy (normals, result, 0, size);
+            }
+
+            Marshal.FreeHGlobal (normals);
+
+            return result;
+        }
+
+        /// <summary>
+        /// build mesh from vertex, face, and normal array
         /// </summary>
         /// <param name="vertices">vertex array for mesh construction</param>
         /// <param name="faces">face array for mesh construction</param>
+        /// <param name="normals">per-vertex normal array for mesh construction</param>
         /// <returns>constructed mesh</returns>
-        private Mesh ConstructMesh (float[] vertices, int[] faces) {
+        private Mesh ConstructMesh (float[] vertices, int[] faces, float[] normals) {
             Mesh constructed = new Mesh ();
 
             // add vertices to mesh
@@ -1042,12 +1715,60 @@ namespace DendroGH {
                 i += 4;
             }
 
+            // add per-vertex normals computed from the level set
+            if (normals != null && normals.Length == vertices.Length) {
+                i = 0;
+                while (i < normals.Length) {
+                    constructed.Normals.Add (normals[i], normals[i + 1], normals[i + 2]);
+
+                    i += 3;
+                }
+            }
+            else {
+                constructed.Normals.ComputeNormals ();
+            }
+
             return constructed;
         }
 
 #endregion Display
 
 #region Helpers
+        /// <summary>
+        /// validate settings and flatten the world xy to plane transform for a primitive
+        /// </summary>
+        /// <param name="vPlane">plane the primitive is built on</param>
+        /// <param name="vSettings">voxelization settings to be used</param>
+        /// <returns>flat transform array</returns>
+        private double[] PrimitiveMatrix (Plane vPlane, DendroSettings vSettings) {
+            // check for invalid voxelsize settings
+            if (vSettings.VoxelSize < 0.01)
+                vSettings.VoxelSize = 0.01;
+
+            // check for invalid bandwidth settings
+            if (vSettings.Bandwidth < 1)
+                vSettings.Bandwidth = 1;
+
+            Transform xform = Rhino.Geometry.Transform.PlaneToPlane (Plane.WorldXY, vPlane);
+
+            // convert transform to flat array
+            float[] floatMatrix = xform.ToFloatArray (false);
+            return Array.ConvertAll (floatMatrix, x => (double) x);
+        }
+
+        /// <summary>
+        /// build the display mesh once a primitive volume was created
+        /// </summary>
+        /// <returns>boolean with whether operation was successful</returns>
+        private bool FinishPrimitive () {
+            if (!this.IsValid)
+                return false;
+
+            this.UpdateDisplay ();
+
+            return true;
+        }
+
         /// <summary>
         /// create a point set, with a corresponding radius value list, for every curve. each curve provided
         /// is divided into points, using its supplied radius value and then added to the whole point set.
@@ -0,0 +1,78 @@
+﻿using System;
+using System.Collections.Generic;
+using Grasshopper.Kernel;
+using Rhino.Geometry;
+
+namespace DendroGH {
+    public class VolumeOffsetBatch : GH_Component {
+        /// <summary>
+        /// Initializes a new instance of the VolumeOffsetBatch class.
+        /// </summary>
+        public VolumeOffsetBatch () : base ("Offset Volumes", "vOffsets",
+            "Offset a list of volumes concurrently in a single call",
+            "Dendro", "Filters") { }
+
+        /// <summary>
+        /// Registers all the input parameters for this component.
+        /// </summary>
+        protected override void RegisterInputParams (GH_Component.GH_InputParamManager pManager) {
+            pManager.AddGenericParameter ("Volumes", "V", "Volumes to offset", GH_ParamAccess.list);
+            pManager.AddNumberParameter ("Distances", "D", "Offset distance for every volume, or a single distance for all of them", GH_ParamAccess.list);
+        }
+
+        /// <summary>
+        /// Registers all the output parameters for this component.
+        /// </summary>
+        protected override void RegisterOutputParams (GH_Component.GH_OutputParamManager pManager) {
+            pManager.AddGenericParameter ("Volumes", "V", "Offset volumes", GH_ParamAccess.list);
+        }
+
+        /// <summary>
+        /// This is the method that actually does the work.
+        /// </summary>
+        /// <param name="DA">The DA object is used to retrieve from inputs and store in outputs.</param>
+        protected override void SolveInstance (IGH_DataAccess DA) {
+            List<DendroVolume> volumes = new List<DendroVolume> ();
+            List<double> oAmounts = new List<double> ();
+
+            if (!DA.GetDataList (0, volumes)) return;
+            if (!DA.GetDataList (1, oAmounts)) return;
+
+            if (oAmounts.Count != 1 && oAmounts.Count != volumes.Count) {
+                AddRuntimeMessage (GH_RuntimeMessageLevel.Error, "Supply a single distance or one distance for every volume");
+                return;
+            }
+
+            List<DendroVolume> offsets = DendroVolume.Offset (volumes, oAmounts, null);
+
+            List<VolumeGOO> results = new List<VolumeGOO> ();
+            foreach (DendroVolume offset in offsets) {
+                if (!offset.IsValid) {
+                    AddRuntimeMessage (GH_RuntimeMessageLevel.Error, "Offset failed. Make sure all supplied volumes are valid");
+                    results.Add (null);
+                }
+                else {
+                    results.Add (new VolumeGOO (offset));
+                }
+            }
+
+            DA.SetDataList (0, results);
+        }
+
+        /// <summary>
+        /// Provides an Icon for the component.
+        /// </summary>
+        protected override System.Drawing.Bitmap Icon {
+            get {
+                return DendroGH.Properties.Resources.ico_offset;
+            }
+        }
+
+        /// <summary>
+        /// Gets the unique ID for this component. Do not change this ID after release.
+        /// </summary>
+        public override Guid ComponentGuid {
+            get { return new Guid ("4646a3a6-255b-4a30-862c-73a4394e72d6"); }
+        }
+    }
+}
\ No newline at end of file
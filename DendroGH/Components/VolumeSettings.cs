@@ -21,6 +21,10 @@ namespace DendroGH {
             pManager.AddNumberParameter ("Isovalue", "I", "Crossing point of the volume that is considered the surface", GH_ParamAccess.item, 0.0);
             pManager.AddNumberParameter ("Adaptivity", "A", "Value range from 0-1. Higher adaptivities will allow more variation " +
                 "in polygon size, resulting in fewer polygons.", GH_ParamAccess.item, 0.1);
+            pManager.AddIntegerParameter ("Face Count", "F", "(Optional) Target face count for mesh decimation. 0 leaves the face count unbounded.", GH_ParamAccess.item, 0);
+            pManager.AddNumberParameter ("Max Error", "E", "(Optional) Maximum deviation allowed by mesh decimation. 0 leaves the error unbounded.", GH_ParamAccess.item, 0.0);
+            pManager[4].Optional = true;
+            pManager[5].Optional = true;
         }
 
         /// <summary>
@@ -39,11 +43,15 @@ namespace DendroGH {
             double voxelSize = 1.0;
             double isoValue = 0.0;
             double adaptivity = 0.1;
+            int faceCount = 0;
+            double maxError = 0.0;
 
             if (!DA.GetData (0, ref voxelSize)) return;
             if (!DA.GetData (1, ref bandwidth)) return;
             if (!DA.GetData (2, ref isoValue)) return;
             if (!DA.GetData (3, ref adaptivity)) return;
+            DA.GetData (4, ref faceCount);
+            DA.GetData (5, ref maxError);
 
             DendroSettings vs = new DendroSettings ();
 
@@ -51,6 +59,8 @@ namespace DendroGH {
             vs.Bandwidth = bandwidth;
             vs.IsoValue = isoValue;
             vs.VoxelSize = voxelSize;
+            vs.FaceCount = Math.Max (faceCount, 0);
+            vs.MaxError = Math.Max (maxError, 0.0);
 
             DA.SetData (0, new SettingsGOO (vs));
         }
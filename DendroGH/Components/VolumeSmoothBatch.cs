@@ -0,0 +1,79 @@
+﻿using System;
+using System.Collections.Generic;
+using Grasshopper.Kernel;
+using Rhino.Geometry;
+
+namespace DendroGH {
+    public class VolumeSmoothBatch : GH_Component {
+        /// <summary>
+        /// Initializes a new instance of the VolumeSmoothBatch class.
+        /// </summary>
+        public VolumeSmoothBatch () : base ("Smooth Volumes", "vSmooths",
+            "Apply smoothing to a list of volumes concurrently in a single call",
+            "Dendro", "Filters") { }
+
+        /// <summary>
+        /// Registers all the input parameters for this component.
+        /// </summary>
+        protected override void RegisterInputParams (GH_Component.GH_InputParamManager pManager) {
+            pManager.AddGenericParameter ("Volumes", "V", "Volumes to smooth", GH_ParamAccess.list);
+            pManager.AddIntegerParameter ("Width", "W", "(Optional) Width of smoothing. This value acts as a multiplier.", GH_ParamAccess.item, 1);
+            pManager.AddIntegerParameter ("Type", "T", "0 - gaussian, 1 - laplacian, 2 - mean, 3 - median", GH_ParamAccess.item, 2);
+            pManager.AddIntegerParameter ("Iterations", "I", "Number of smoothing iterations", GH_ParamAccess.item, 1);
+        }
+
+        /// <summary>
+        /// Registers all the output parameters for this component.
+        /// </summary>
+        protected override void RegisterOutputParams (GH_Component.GH_OutputParamManager pManager) {
+            pManager.AddGenericParameter ("Volumes", "V", "Smoothed volumes", GH_ParamAccess.list);
+        }
+
+        /// <summary>
+        /// This is the method that actually does the work.
+        /// </summary>
+        /// <param name="DA">The DA object is used to retrieve from inputs and store in outputs.</param>
+        protected override void SolveInstance (IGH_DataAccess DA) {
+            List<DendroVolume> volumes = new List<DendroVolume> ();
+            int sType = 1;
+            int sIterations = 1;
+            int sWidth = 1;
+
+            if (!DA.GetDataList (0, volumes)) return;
+            if (!DA.GetData (1, ref sWidth)) return;
+            if (!DA.GetData (2, ref sType)) return;
+            if (!DA.GetData (3, ref sIterations)) return;
+
+            List<DendroVolume> smooths = DendroVolume.Smooth (volumes, sType, sIterations, sWidth, null);
+
+            List<VolumeGOO> results = new List<VolumeGOO> ();
+            foreach (DendroVolume smooth in smooths) {
+                if (!smooth.IsValid) {
+                    AddRuntimeMessage (GH_RuntimeMessageLevel.Error, "Smooth failed. Make sure all supplied volumes are valid");
+                    results.Add (null);
+                }
+                else {
+                    results.Add (new VolumeGOO (smooth));
+                }
+            }
+
+            DA.SetDataList (0, results);
+        }
+
+        /// <summary>
+        /// Provides an Icon for the component.
+        /// </summary>
+        protected override System.Drawing.Bitmap Icon {
+            get {
+                return DendroGH.Properties.Resources.ico_smooth;
+            }
+        }
+
+        /// <summary>
+        /// Gets the unique ID for this component. Do not change this ID after release.
+        /// </summary>
+        public override Guid ComponentGuid {
+            get { return new Guid ("5e25241b-15e4-4425-86fa-08e4bb3e0b8f"); }
+        }
+    }
+}
\ No newline at end of file